@@ -0,0 +1,234 @@
+/* grammar_cache.h
+   On-disk cache of grammar analysis shared by the tools (slr_real.c,
+   print_first_follow.c, ll1_parsing.c): symbol names, nullable, FIRST and
+   FOLLOW, keyed by the grammar's productions.
+   A tool normalizes its productions into a GrammarKey, symbol by symbol
+   as it splits them (gcache_key_sym/end), and asks gcache_load() for
+   the facts. On a miss it computes them itself and gcache_store()s them.
+   Entries are files named by the 64-bit FNV-1a hash of the key in the
+   directory given by the GRAMMAR_CACHE environment variable; without it
+   caching is off. The key text is stored too, so a hash collision is a
+   miss, not a wrong answer. Entries are written to a temporary file and
+   renamed into place, so concurrent runs never see a partial one.
+   Sets are bitsets over the entry's terminals (including $); tools map
+   terminals and nonterminals to their own ids by name.
+*/
+#ifndef GRAMMAR_CACHE_H
+#define GRAMMAR_CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define GCACHE_MAGIC "GRMCACH1"
+
+// normalized productions: each is lhs NUL rhs1 NUL ... rhsn NUL '\n'
+typedef struct {
+    char *text;
+    size_t len, cap;
+} GrammarKey;
+
+typedef struct {
+    int nterm, nnon;
+    char **term, **non;         // names
+    int words;                  // 64-bit words per set row
+    unsigned char *nullable;    // per nonterminal
+    uint64_t *first, *follow;   // nnon rows of words over terminals
+} GrammarFacts;
+
+#define GCACHE_FIRST(G, A) ((G)->first + (size_t)(A) * (G)->words)
+#define GCACHE_FOLLOW(G, A) ((G)->follow + (size_t)(A) * (G)->words)
+
+static inline void gcache_key_put(GrammarKey *K, const char *s, size_t n) {
+    if (K->len + n > K->cap) {
+        K->cap = K->cap ? 2 * K->cap : 256;
+        while (K->cap < K->len + n) K->cap *= 2;
+        K->text = realloc(K->text, K->cap);
+    }
+    memcpy(K->text + K->len, s, n);
+    K->len += n;
+}
+
+// a production is its lhs and each rhs symbol (none for epsilon), then end
+static inline void gcache_key_sym(GrammarKey *K, const char *name, size_t n) {
+    gcache_key_put(K, name, n);
+    gcache_key_put(K, "", 1);
+}
+
+static inline void gcache_key_end(GrammarKey *K) {
+    gcache_key_put(K, "\n", 1);
+}
+
+static inline void gcache_key_free(GrammarKey *K) {
+    free(K->text);
+    memset(K, 0, sizeof(*K));
+}
+
+static inline uint64_t gcache_hash(const GrammarKey *K) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < K->len; i++) h = (h ^ (unsigned char)K->text[i]) * 1099511628211ULL;
+    return h;
+}
+
+static inline const char *gcache_dir(void) {
+    const char *d = getenv("GRAMMAR_CACHE");
+    return d && *d ? d : NULL;
+}
+
+static inline int gcache_enabled(void) {
+    return gcache_dir() != NULL;
+}
+
+// facts with room for nterm terminals and nnon nonterminals, sets empty
+static inline void gcache_facts_init(GrammarFacts *G, int nterm, int nnon) {
+    G->nterm = nterm;
+    G->nnon = nnon;
+    G->words = (nterm + 63) / 64;
+    G->term = calloc(nterm + 1, sizeof(char *));
+    G->non = calloc(nnon + 1, sizeof(char *));
+    G->nullable = calloc(nnon + 1, 1);
+    G->first = calloc((size_t)nnon * G->words + 1, sizeof(uint64_t));
+    G->follow = calloc((size_t)nnon * G->words + 1, sizeof(uint64_t));
+}
+
+static inline void gcache_facts_free(GrammarFacts *G) {
+    for (int t = 0; t < G->nterm; t++) free(G->term[t]);
+    for (int A = 0; A < G->nnon; A++) free(G->non[A]);
+    free(G->term); free(G->non); free(G->nullable); free(G->first); free(G->follow);
+    memset(G, 0, sizeof(*G));
+}
+
+// index of the terminal or nonterminal named s[0..n), or -1
+static inline int gcache_find(char **names, int count, const char *s, size_t n) {
+    for (int i = 0; i < count; i++)
+        if (strlen(names[i]) == n && memcmp(names[i], s, n) == 0) return i;
+    return -1;
+}
+
+static inline void gcache_path(char *path, size_t size, const char *dir, uint64_t h, const char *suffix) {
+    snprintf(path, size, "%s/%016llx%s", dir, (unsigned long long)h, suffix);
+}
+
+// bounds-checked reader over a loaded entry
+typedef struct {
+    const unsigned char *p, *end;
+    int bad;
+} GcacheReader;
+
+static inline void gcache_read(GcacheReader *R, void *dst, size_t n) {
+    if (R->bad || (size_t)(R->end - R->p) < n) {
+        R->bad = 1;
+        memset(dst, 0, n);
+        return;
+    }
+    memcpy(dst, R->p, n);
+    R->p += n;
+}
+
+static inline char *gcache_read_name(GcacheReader *R) {
+    int32_t n;
+    gcache_read(R, &n, sizeof(n));
+    if (R->bad || n < 0 || (size_t)(R->end - R->p) < (size_t)n) {
+        R->bad = 1;
+        return strdup("");
+    }
+    char *s = malloc(n + 1);
+    gcache_read(R, s, n);
+    s[n] = 0;
+    return s;
+}
+
+// 0 and G filled if the cache has this grammar, -1 otherwise
+static inline int gcache_load(const GrammarKey *K, GrammarFacts *G) {
+    const char *dir = gcache_dir();
+    if (!dir) return -1;
+    char path[4096];
+    gcache_path(path, sizeof(path), dir, gcache_hash(K), "");
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    unsigned char *buf = NULL;
+    size_t len = 0, cap = 0, n;
+    do {
+        if (len == cap) {
+            cap = cap ? 2 * cap : 65536;
+            buf = realloc(buf, cap);
+        }
+        n = fread(buf + len, 1, cap - len, f);
+        len += n;
+    } while (n > 0);
+    fclose(f);
+
+    GcacheReader R = { buf, buf + len, 0 };
+    char magic[8];
+    uint64_t textlen;
+    int32_t hdr[2];
+    gcache_read(&R, magic, sizeof(magic));
+    gcache_read(&R, &textlen, sizeof(textlen));
+    if (R.bad || memcmp(magic, GCACHE_MAGIC, 8) != 0 || textlen != K->len
+        || (size_t)(R.end - R.p) < K->len || memcmp(R.p, K->text, K->len) != 0) {
+        free(buf);
+        return -1;
+    }
+    R.p += K->len;
+    gcache_read(&R, hdr, sizeof(hdr));
+    if (R.bad || hdr[0] < 0 || hdr[1] < 0 || hdr[0] > (R.end - R.p) || hdr[1] > (R.end - R.p)) {
+        free(buf);
+        return -1;
+    }
+    gcache_facts_init(G, hdr[0], hdr[1]);
+    for (int t = 0; t < G->nterm; t++) G->term[t] = gcache_read_name(&R);
+    for (int A = 0; A < G->nnon; A++) G->non[A] = gcache_read_name(&R);
+    size_t rows = (size_t)G->nnon * G->words * sizeof(uint64_t);
+    gcache_read(&R, G->nullable, G->nnon);
+    gcache_read(&R, G->first, rows);
+    gcache_read(&R, G->follow, rows);
+    free(buf);
+    if (R.bad) {
+        gcache_facts_free(G);
+        return -1;
+    }
+    return 0;
+}
+
+static inline void gcache_write_name(FILE *f, const char *s) {
+    int32_t n = strlen(s);
+    fwrite(&n, sizeof(n), 1, f);
+    fwrite(s, 1, n, f);
+}
+
+// store G as the facts of this grammar; 0 on success
+static inline int gcache_store(const GrammarKey *K, const GrammarFacts *G) {
+    const char *dir = gcache_dir();
+    if (!dir) return -1;
+    uint64_t h = gcache_hash(K);
+    char path[4096], tmp[4096 + 32];
+    gcache_path(path, sizeof(path), dir, h, "");
+    snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid());
+    FILE *f = fopen(tmp, "wb");
+    if (!f) {
+        perror(tmp);
+        return -1;
+    }
+    uint64_t textlen = K->len;
+    int32_t hdr[2] = { G->nterm, G->nnon };
+    size_t rows = (size_t)G->nnon * G->words;
+    fwrite(GCACHE_MAGIC, 1, 8, f);
+    fwrite(&textlen, sizeof(textlen), 1, f);
+    fwrite(K->text, 1, K->len, f);
+    fwrite(hdr, sizeof(hdr), 1, f);
+    for (int t = 0; t < G->nterm; t++) gcache_write_name(f, G->term[t]);
+    for (int A = 0; A < G->nnon; A++) gcache_write_name(f, G->non[A]);
+    fwrite(G->nullable, 1, G->nnon, f);
+    fwrite(G->first, sizeof(uint64_t), rows, f);
+    fwrite(G->follow, sizeof(uint64_t), rows, f);
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        perror(path);
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+#endif
@@ -1,120 +1,587 @@
 // This program:
-// 1. Builds LL(1) parsing table for given grammar
+// 1. Builds the LL(1) parsing table for a grammar from its FIRST/FOLLOW sets
 // 2. Uses a stack to parse an input string
 // 3. Accepts/rejects the string
+//
+// Usage:
+//   ./ll1_parsing                  built-in expression grammar (E->TE' ...)
+//   ./ll1_parsing --grammar FILE   productions from FILE, one per line: A->alpha|beta
+//   ./ll1_parsing --table          also print the generated table
+//   ./ll1_parsing --quiet          parse the input string without the step trace
+//   ./ll1_parsing --batch FILE     parse every line of FILE without tracing and report
+//                                  accept/reject per line and tokens/sec
+// Nonterminals are the names left of "->" (E, E', expr); an uppercase letter
+// on the right with no productions is one too. Every other character on the
+// right is a terminal, blanks separate symbols and # is epsilon.
+// A cell claimed by two productions is an LL(1) conflict: each one is
+// reported and the first production keeps the cell. Such a table can derive
+// X =>+ X... without reading input; the driver rejects that instead of
+// looping (tests/ll1_cycles.sh).
+// With GRAMMAR_CACHE=DIR, nullable/FIRST/FOLLOW are shared with the other
+// tools through grammar_cache.h.
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <time.h>
+#include "grammar_cache.h"
 
 #define MAX 100
+#define MAXLINE 4096
 
-// Parsing table for the grammar
-// Non-terminals: E, E', T, T', F
-// Terminals: i, +, *, (, ), $
-char table[5][6][10] = {
-    /* E  */ {"TE'", "", "", "TE'", "", ""},
-    /* E' */ {"", "+TE'", "", "", "#", "#"},
-    /* T  */ {"FT'", "", "", "FT'", "", ""},
-    /* T' */ {"", "#", "*FT'", "", "#", "#"},
-    /* F  */ {"i", "", "", "(E)", "", ""}
+// Built-in grammar
+const char *exprGrammar[] = {
+    "E->TE'",
+    "E'->+TE'|#",
+    "T->FT'",
+    "T'->*FT'|#",
+    "F->i|(E)",
+    NULL
 };
 
-char *nonTerm[] = {"E", "E'", "T", "T'", "F"};   // Non-terminals
-char term[] = {'i', '+', '*', '(', ')', '$'};    // Terminals
+// Symbols are dense ids: terminals 0..termCnt-1 ($ included), then the
+// nonterminals, so nonterminal X has table row X - termCnt
+char **ntName;                  // nonterminal names
+int ntCnt = 0, ntCap = 0;
+char termName[256][2];          // terminal ids -> one-character names
+int termCnt = 0;
+int termId[256];                // input character -> terminal id, -1 if none
+int eofId;                      // id of $
+#define ROW(X) ((X) - termCnt)
 
-// Function to get row for non-terminal
-int row(char *sym) {
-    for (int i = 0; i < 5; i++)
-        if (strcmp(nonTerm[i], sym) == 0)
-            return i;
-    return -1;
+typedef struct {
+    int lhs;                    // nonterminal index
+    char *alt;                  // rhs as written, "#" for epsilon
+    int start, len;             // rhs symbols, last first, in rhsRev[start..start+len)
+} Production;
+
+Production *prods;
+int prodCnt = 0, prodCap = 0;
+int *rhsRev;                    // every rhs reversed, back to back
+int rhsLen = 0, rhsCap = 0;
+#define RHS(p, k) rhsRev[prods[p].start + prods[p].len - 1 - (k)]   // k-th symbol
+
+// FIRST/FOLLOW are bitsets over terminal ids, one row per nonterminal
+int words;
+uint64_t *firstSet, *followSet;
+char *nullable;
+#define FIRST(A) (firstSet + (size_t)(A) * words)
+#define FOLLOW(A) (followSet + (size_t)(A) * words)
+
+// LL(1) table: production id or -1 for each (nonterminal, terminal)
+int *table;
+#define TABLE(A, t) table[(size_t)(A) * termCnt + (t)]
+
+int setBit(uint64_t *set, int t) {
+    uint64_t old = set[t / 64];
+    set[t / 64] |= 1ULL << (t % 64);
+    return set[t / 64] != old;
+}
+
+int hasBit(const uint64_t *set, int t) {
+    return (set[t / 64] >> (t % 64)) & 1;
+}
+
+// set = set U other, returns 1 if set grew
+int orBits(uint64_t *set, const uint64_t *other) {
+    int grew = 0;
+    for (int w = 0; w < words; w++) {
+        uint64_t v = set[w] | other[w];
+        if (v != set[w]) {
+            set[w] = v;
+            grew = 1;
+        }
+    }
+    return grew;
 }
 
-// Function to get column for terminal
-int column(char c) {
-    for (int i = 0; i < 6; i++)
-        if (term[i] == c)
-            return i;
-    return -1;
+int isNonTerminal(int X) {
+    return X >= termCnt;
 }
 
-// Function to check if a symbol is a non-terminal (E, E', T, T', F)
-int isNonTerminal(char *sym) {
-    for (int i = 0; i < 5; i++) {
-        if (strcmp(nonTerm[i], sym) == 0) return 1;
+const char *symName(int X) {
+    return isNonTerminal(X) ? ntName[ROW(X)] : termName[X];
+}
+
+// index of the nonterminal named s[0..n), added if new
+int nonTerminal(const char *s, int n) {
+    for (int A = 0; A < ntCnt; A++)
+        if ((int)strlen(ntName[A]) == n && strncmp(ntName[A], s, n) == 0) return A;
+    if (ntCnt == ntCap) {
+        ntCap = ntCap ? 2 * ntCap : 16;
+        ntName = realloc(ntName, ntCap * sizeof(char *));
+    }
+    ntName[ntCnt] = strndup(s, n);
+    return ntCnt++;
+}
+
+void pushRhs(int X) {
+    if (rhsLen == rhsCap) {
+        rhsCap = rhsCap ? 2 * rhsCap : 64;
+        rhsRev = realloc(rhsRev, rhsCap * sizeof(int));
+    }
+    rhsRev[rhsLen++] = X;
+}
+
+char *trim(char *s) {
+    while (isspace((unsigned char)*s)) s++;
+    char *e = s + strlen(s);
+    while (e > s && isspace((unsigned char)e[-1])) e--;
+    *e = 0;
+    return s;
+}
+
+// "A->alpha|beta": one production per alternative, rhs split later
+int addRule(const char *rule) {
+    char line[MAXLINE];
+    snprintf(line, sizeof(line), "%s", rule);
+    char *arrow = strstr(line, "->");
+    if (arrow == NULL) {
+        fprintf(stderr, "skipping %s: expected A->alpha\n", rule);
+        return -1;
+    }
+    *arrow = 0;
+    char *lhs = trim(line);
+    if (*lhs == 0) {
+        fprintf(stderr, "skipping %s: missing left side\n", rule);
+        return -1;
+    }
+    int A = nonTerminal(lhs, strlen(lhs));
+    char *save;
+    for (char *alt = strtok_r(arrow + 2, "|", &save); alt != NULL; alt = strtok_r(NULL, "|", &save)) {
+        alt = trim(alt);
+        if (prodCnt == prodCap) {
+            prodCap = prodCap ? 2 * prodCap : MAX;
+            prods = realloc(prods, prodCap * sizeof(Production));
+        }
+        prods[prodCnt].lhs = A;
+        prods[prodCnt].alt = strdup(*alt ? alt : "#");
+        prodCnt++;
     }
     return 0;
 }
 
-int main() {
-    char stack[MAX][MAX];  // stack of symbols (each can be E, E', T etc.)
-    char input[MAX];
-    int top = 0;
+int readGrammar(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    char line[MAXLINE];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char *rule = trim(line);
+        if (*rule) addRule(rule);
+    }
+    fclose(f);
+    return 0;
+}
 
-    printf("Enter input string (end with $): ");
-    scanf("%s", input);
+// Split every rhs into symbol ids once all left sides are known: the
+// longest nonterminal name wins, then an uppercase letter, then a single
+// character terminal. Symbols are first collected as character codes and
+// 256 + nonterminal, and renumbered when the terminals are all known.
+void splitRhs() {
+    memset(termId, -1, sizeof(termId));
+    int definedCnt = ntCnt;
+    for (int p = 0; p < prodCnt; p++) {
+        prods[p].start = rhsLen;
+        for (const char *c = prods[p].alt; *c;) {
+            if (isspace((unsigned char)*c) || *c == '#') {
+                c++;
+                continue;
+            }
+            int best = -1, bestLen = 0;
+            for (int A = 0; A < definedCnt; A++) {
+                int n = strlen(ntName[A]);
+                if (n > bestLen && strncmp(c, ntName[A], n) == 0) {
+                    best = A;
+                    bestLen = n;
+                }
+            }
+            if (best < 0 && isupper((unsigned char)*c)) {
+                best = nonTerminal(c, 1);
+                bestLen = 1;
+            }
+            if (best >= 0) {
+                pushRhs(256 + best);
+                c += bestLen;
+            } else {
+                unsigned char u = *c++;
+                if (termId[u] < 0) termId[u] = termCnt++;
+                pushRhs(u);
+            }
+        }
+        prods[p].len = rhsLen - prods[p].start;
+        // reverse in place
+        for (int i = prods[p].start, j = rhsLen - 1; i < j; i++, j--) {
+            int t = rhsRev[i];
+            rhsRev[i] = rhsRev[j];
+            rhsRev[j] = t;
+        }
+    }
+    if (termId['$'] < 0) termId['$'] = termCnt++;
+    eofId = termId['$'];
+    for (int c = 0; c < 256; c++) {
+        if (termId[c] < 0) continue;
+        termName[termId[c]][0] = c;
+        termName[termId[c]][1] = 0;
+    }
+    for (int i = 0; i < rhsLen; i++)
+        rhsRev[i] = rhsRev[i] >= 256 ? termCnt + rhsRev[i] - 256 : termId[rhsRev[i]];
+}
 
-    // initialize stack
-    strcpy(stack[top], "$");
-    strcpy(stack[++top], "E"); // start symbol
+// Nullable and FIRST together, then FOLLOW, each iterated until no set
+// grows. FOLLOW scans each rhs right to left carrying FIRST of the suffix.
+void computeFirstFollow() {
+    int changed;
+    do {
+        changed = 0;
+        for (int p = 0; p < prodCnt; p++) {
+            int A = prods[p].lhs, k;
+            for (k = 0; k < prods[p].len; k++) {
+                int X = RHS(p, k);
+                if (!isNonTerminal(X)) {
+                    changed |= setBit(FIRST(A), X);
+                    break;
+                }
+                changed |= orBits(FIRST(A), FIRST(ROW(X)));
+                if (!nullable[ROW(X)]) break;
+            }
+            if (k == prods[p].len && !nullable[A]) {
+                nullable[A] = 1;
+                changed = 1;
+            }
+        }
+    } while (changed);
 
-    char *p = input;
-    printf("\nStack\t\tInput\t\tAction\n");
+    uint64_t *trailer = malloc(words * sizeof(uint64_t));
+    setBit(FOLLOW(prods[0].lhs), eofId);
+    do {
+        changed = 0;
+        for (int p = 0; p < prodCnt; p++) {
+            int A = prods[p].lhs;
+            memcpy(trailer, FOLLOW(A), words * sizeof(uint64_t));
+            for (int k = prods[p].len - 1; k >= 0; k--) {
+                int X = RHS(p, k);
+                if (!isNonTerminal(X)) {
+                    memset(trailer, 0, words * sizeof(uint64_t));
+                    setBit(trailer, X);
+                    continue;
+                }
+                changed |= orBits(FOLLOW(ROW(X)), trailer);
+                if (!nullable[ROW(X)]) memset(trailer, 0, words * sizeof(uint64_t));
+                orBits(trailer, FIRST(ROW(X)));
+            }
+        }
+    } while (changed);
+    free(trailer);
+}
 
-    while (top >= 0) {
-        // print stack
-        for (int i = 0; i <= top; i++) printf("%s", stack[i]);
-        printf("\t\t%s\t\t", p);
+void grammarKey(GrammarKey *key) {
+    for (int p = 0; p < prodCnt; p++) {
+        gcache_key_sym(key, ntName[prods[p].lhs], strlen(ntName[prods[p].lhs]));
+        for (int k = 0; k < prods[p].len; k++)
+            gcache_key_sym(key, symName(RHS(p, k)), strlen(symName(RHS(p, k))));
+        gcache_key_end(key);
+    }
+}
 
-        // if top of stack is terminal
-        if (strlen(stack[top]) == 1 && stack[top][0] == *p) {
-            printf("Match %c\n", *p);
-            top--;
-            p++;
+// sets from cached facts, 0 if all our nonterminals are in them
+int loadFacts(const GrammarFacts *g) {
+    int *rowOf = malloc((ntCnt + 1) * sizeof(int));
+    for (int A = 0; A < ntCnt; A++) {
+        rowOf[A] = gcache_find(g->non, g->nnon, ntName[A], strlen(ntName[A]));
+        if (rowOf[A] < 0) {
+            free(rowOf);
+            return -1;
         }
-        else if (isNonTerminal(stack[top])) {
-            int r = row(stack[top]);
-            int c = column(*p);
-            char *prod = table[r][c];
-            if (strlen(prod) == 0) {
-                printf("Error\n");
+    }
+    for (int A = 0; A < ntCnt; A++) {
+        int i = rowOf[A];
+        nullable[A] = g->nullable[i];
+        for (int u = 0; u < g->nterm; u++) {
+            if (strlen(g->term[u]) != 1) continue;
+            int t = termId[(unsigned char)g->term[u][0]];
+            if (t < 0) continue;
+            if (hasBit(GCACHE_FIRST(g, i), u)) setBit(FIRST(A), t);
+            if (hasBit(GCACHE_FOLLOW(g, i), u)) setBit(FOLLOW(A), t);
+        }
+    }
+    free(rowOf);
+    return 0;
+}
+
+void storeFacts(GrammarFacts *g) {
+    gcache_facts_init(g, termCnt, ntCnt);
+    for (int t = 0; t < termCnt; t++) g->term[t] = strdup(termName[t]);
+    for (int A = 0; A < ntCnt; A++) g->non[A] = strdup(ntName[A]);
+    memcpy(g->nullable, nullable, ntCnt);
+    memcpy(g->first, firstSet, (size_t)ntCnt * words * sizeof(uint64_t));
+    memcpy(g->follow, followSet, (size_t)ntCnt * words * sizeof(uint64_t));
+}
+
+// nullable, FIRST and FOLLOW, from $GRAMMAR_CACHE when it has this grammar
+void analyzeGrammar() {
+    words = (termCnt + 63) / 64;
+    nullable = calloc(ntCnt, 1);
+    firstSet = calloc((size_t)ntCnt * words, sizeof(uint64_t));
+    followSet = calloc((size_t)ntCnt * words, sizeof(uint64_t));
+    if (!gcache_enabled()) {
+        computeFirstFollow();
+        return;
+    }
+    GrammarKey key = {0};
+    GrammarFacts facts = {0};
+    grammarKey(&key);
+    int hit = 0;
+    if (gcache_load(&key, &facts) == 0) {
+        hit = loadFacts(&facts) == 0;
+        gcache_facts_free(&facts);
+    }
+    if (!hit) {
+        memset(nullable, 0, ntCnt);
+        memset(firstSet, 0, (size_t)ntCnt * words * sizeof(uint64_t));
+        memset(followSet, 0, (size_t)ntCnt * words * sizeof(uint64_t));
+        computeFirstFollow();
+        storeFacts(&facts);
+        gcache_store(&key, &facts);
+        gcache_facts_free(&facts);
+    }
+    gcache_key_free(&key);
+}
+
+void setEntry(int A, int t, int p, int *conflicts) {
+    int q = TABLE(A, t);
+    if (q == p) return;
+    if (q < 0) {
+        TABLE(A, t) = p;
+        return;
+    }
+    fprintf(stderr, "LL(1) conflict at M[%s, %s]: %s->%s and %s->%s\n",
+            ntName[A], termName[t], ntName[A], prods[q].alt, ntName[A], prods[p].alt);
+    (*conflicts)++;
+}
+
+// M[A, t] = A->alpha for t in FIRST(alpha), and for t in FOLLOW(A) when
+// alpha is nullable; returns the number of conflicts
+int buildTable() {
+    int conflicts = 0;
+    uint64_t *first = malloc(words * sizeof(uint64_t));
+    table = malloc((size_t)ntCnt * termCnt * sizeof(int));
+    for (size_t i = 0; i < (size_t)ntCnt * termCnt; i++) table[i] = -1;
+    for (int p = 0; p < prodCnt; p++) {
+        int A = prods[p].lhs, k;
+        memset(first, 0, words * sizeof(uint64_t));
+        for (k = 0; k < prods[p].len; k++) {
+            int X = RHS(p, k);
+            if (!isNonTerminal(X)) {
+                setBit(first, X);
                 break;
             }
-            else if (strcmp(prod, "#") == 0) { // epsilon
-                printf("%s -> ε\n", stack[top]);
-                top--;
+            orBits(first, FIRST(ROW(X)));
+            if (!nullable[ROW(X)]) break;
+        }
+        if (k == prods[p].len) orBits(first, FOLLOW(A));
+        for (int t = 0; t < termCnt; t++)
+            if (hasBit(first, t)) setEntry(A, t, p, &conflicts);
+    }
+    free(first);
+    return conflicts;
+}
+
+void printTable() {
+    printf("%-8s", "");
+    for (int t = 0; t < termCnt; t++) printf("%-10s", termName[t]);
+    printf("\n");
+    for (int A = 0; A < ntCnt; A++) {
+        printf("%-8s", ntName[A]);
+        for (int t = 0; t < termCnt; t++) printf("%-10s", TABLE(A, t) < 0 ? "" : prods[TABLE(A, t)].alt);
+        printf("\n");
+    }
+}
+
+// Parser stack of symbol ids, bottom first, grown as needed. An expansion
+// replaces the top nonterminal with its reversed rhs in one memcpy.
+// A table with conflicts can keep a derivation X =>+ X... that never reads
+// input (S->S|a, S->A|b with A->S|a). The stack remembers the step and
+// height of each nonterminal's last expansion and the step each slot was
+// last vacated: expanding X again before any match, while the slot of its
+// last expansion was never vacated, repeats forever and is rejected.
+typedef struct {
+    int *sym;
+    int top, cap;       // index of the top symbol
+    long step;          // steps so far, over all parses
+    long *vacated;      // per slot: step at which the top last fell below it
+    long *lastStep;     // per nonterminal: step of its last expansion
+    int *lastHeight;    // and the slot it was expanded in
+} SymStack;
+
+// room for n more symbols above the top
+void reserve(SymStack *st, int n) {
+    if (st->top + 1 + n <= st->cap) return;
+    int old = st->cap;
+    while (st->cap < st->top + 1 + n) st->cap = st->cap ? 2 * st->cap : 64;
+    st->sym = realloc(st->sym, st->cap * sizeof(int));
+    st->vacated = realloc(st->vacated, st->cap * sizeof(long));
+    memset(st->vacated + old, 0, (st->cap - old) * sizeof(long));
+}
+
+void freeStack(SymStack *st) {
+    free(st->sym);
+    free(st->vacated);
+    free(st->lastStep);
+    free(st->lastHeight);
+}
+
+// Parse input, which ends with $. With trace, print the stack, the rest of
+// the input and the action of every step. Returns 1 on accept; *matched
+// counts the terminals matched.
+int parse(SymStack *st, const char *input, int trace, long *matched) {
+    const char *p = input;
+    if (st->lastStep == NULL) {
+        st->lastStep = calloc(ntCnt, sizeof(long));
+        st->lastHeight = calloc(ntCnt, sizeof(int));
+    }
+    reserve(st, 2);
+    // initialize stack
+    st->top = 0;
+    st->sym[0] = eofId;
+    st->sym[++st->top] = termCnt + prods[0].lhs; // start symbol
+    long lastMatch = ++st->step;
+
+    while (st->top >= 0) {
+        long step = ++st->step;
+        if (trace) {
+            // print stack
+            for (int i = 0; i <= st->top; i++) printf("%s", symName(st->sym[i]));
+            printf("\t\t%s\t\t", p);
+        }
+        int X = st->sym[st->top];
+        int c = termId[(unsigned char)*p];
+        // if top of stack is terminal
+        if (!isNonTerminal(X) && *p && X == c) {
+            if (trace) printf("Match %c\n", *p);
+            st->vacated[st->top--] = step;
+            p++;
+            (*matched)++;
+            lastMatch = step;
+        }
+        else if (isNonTerminal(X) && *p && c >= 0 && TABLE(ROW(X), c) >= 0) {
+            const Production *prod = &prods[TABLE(ROW(X), c)];
+            int A = ROW(X), h = st->lastHeight[A];
+            if (st->lastStep[A] > lastMatch && h <= st->top && st->vacated[h] < st->lastStep[A]) {
+                if (trace) printf("Error: %s derives itself without reading input\n", symName(X));
+                return 0;
             }
-            else {
-                printf("%s -> %s\n", stack[top], prod);
-                char tmp[MAX];
-                strcpy(tmp, prod);
-                top--;
-
-                // push RHS in reverse order (each symbol could be E', T', etc.)
-                for (int j = strlen(tmp) - 1; j >= 0;) {
-                    if (j > 0 && tmp[j] == '\'') { // handle E', T'
-                        char sym[3] = {tmp[j-1], '\'', '\0'};
-                        strcpy(stack[++top], sym);
-                        j -= 2;
-                    } else {
-                        char sym[2] = {tmp[j], '\0'};
-                        strcpy(stack[++top], sym);
-                        j--;
-                    }
-                }
+            st->lastStep[A] = step;
+            st->lastHeight[A] = st->top;
+            if (trace) {
+                if (prod->len == 0) printf("%s -> ε\n", symName(X)); // epsilon
+                else printf("%s -> %s\n", symName(X), prod->alt);
             }
+            if (prod->len == 0) st->vacated[st->top] = step;
+            reserve(st, prod->len);
+            memcpy(st->sym + st->top, rhsRev + prod->start, prod->len * sizeof(int));
+            st->top += prod->len - 1;
         }
         else {
-            printf("Error\n");
-            break;
+            if (trace) printf("Error\n");
+            return 0;
+        }
+
+        if (st->top >= 0 && st->sym[st->top] == eofId && *p == '$') {
+            if (trace) printf("Accept\n");
+            return 1;
+        }
+    }
+    return 0;
+}
+
+double nowSec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Parse every line of path without tracing ($ is added when missing) and
+// print accept/reject per line, then the totals and throughput.
+int runBatch(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return 1;
+    }
+    SymStack st = {0};
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    long lines = 0, accepted = 0, tokens = 0;
+    double parseSec = 0;
+    while ((len = getline(&line, &cap, f)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = 0;
+        if (len == 0 || line[len - 1] != '$') {
+            if ((size_t)len + 2 > cap) {
+                cap = len + 2;
+                line = realloc(line, cap);
+            }
+            line[len++] = '$';
+            line[len] = 0;
         }
+        double t0 = nowSec();
+        int ok = parse(&st, line, 0, &tokens);
+        parseSec += nowSec() - t0;
+        printf("%ld: %s\n", ++lines, ok ? "accept" : "reject");
+        accepted += ok;
+    }
+    fclose(f);
+    free(line);
+    freeStack(&st);
+    printf("%ld lines, %ld accepted, %ld rejected; %ld tokens in %.3f s (%.0f tokens/sec)\n",
+           lines, accepted, lines - accepted, tokens, parseSec, parseSec > 0 ? tokens / parseSec : 0);
+    return 0;
+}
 
-        if (strcmp(stack[top], "$") == 0 && *p == '$') {
-            printf("Accept\n");
-            break;
+int main(int argc, char **argv) {
+    const char *grammarFile = NULL, *batchFile = NULL;
+    int showTable = 0, trace = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--grammar") == 0 && i + 1 < argc) grammarFile = argv[++i];
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) batchFile = argv[++i];
+        else if (strcmp(argv[i], "--table") == 0) showTable = 1;
+        else if (strcmp(argv[i], "--quiet") == 0) trace = 0;
+        else {
+            fprintf(stderr, "usage: %s [--grammar FILE] [--table] [--quiet] [--batch FILE]\n", argv[0]);
+            return 1;
         }
     }
+    if (grammarFile != NULL) {
+        if (readGrammar(grammarFile) != 0) return 1;
+    } else {
+        for (int i = 0; exprGrammar[i] != NULL; i++) addRule(exprGrammar[i]);
+    }
+    if (prodCnt == 0) {
+        fprintf(stderr, "No productions\n");
+        return 1;
+    }
+    splitRhs();
+    analyzeGrammar();
+    int conflicts = buildTable();
+    if (conflicts > 0)
+        fprintf(stderr, "grammar is not LL(1): %d conflicts, first production kept\n", conflicts);
+    if (showTable) printTable();
+    if (batchFile != NULL) return runBatch(batchFile);
+
+    char input[MAXLINE];
+    printf("Enter input string (end with $): ");
+    if (scanf("%4095s", input) != 1) return 0;
+
+    SymStack st = {0};
+    long matched = 0;
+    if (trace) printf("\nStack\t\tInput\t\tAction\n");
+    int ok = parse(&st, input, trace, &matched);
+    if (!trace) printf("\n%s\n", ok ? "Accept" : "Error");
+    freeStack(&st);
     return 0;
 }
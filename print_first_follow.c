@@ -1,33 +1,62 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
+#include "grammar_cache.h"
 
 #define MAX 100
+#define MAXLINE 4096
+#define NT 26   // nonterminals are A..Z
+
+// a set of characters, one bit per code
+typedef struct {
+    unsigned long long w[4];
+} CharSet;
 
 struct Productions {
     char lhs;
-    char rhs[20];
-} prod[MAX];
+    char *rhs;
+} *prod;
 
 int prodCnt = 0;
-char nonTerminals[MAX];
+int prodCap = 0;
+char nonTerminals[NT + 1];
 int nonTermCnt = 0;
 
 char terminals[MAX];
 int termCnt = 0;
 
-char firstSets[26][MAX];
-char followSets[26][MAX];
-int visitedFirst[26];
-int visitedFollow[26];
+CharSet firstSets[NT];
+CharSet followSets[NT];
+int nullable[NT];
+
+void addSymbol(CharSet *set, char c) {
+    unsigned char u = c;
+    set->w[u >> 6] |= 1ULL << (u & 63);
+}
+
+int hasSymbol(const CharSet *set, char c) {
+    unsigned char u = c;
+    return (set->w[u >> 6] >> (u & 63)) & 1;
+}
+
+void removeSymbol(CharSet *set, char c) {
+    unsigned char u = c;
+    set->w[u >> 6] &= ~(1ULL << (u & 63));
+}
 
-void addSymbol(char *set, char c) {
-    // c not in set
-    if (strchr(set, c) == NULL) {
-        int len = strlen(set);
-        set[len] = c;
-        set[len + 1] = '\0';
-    } 
+// set = set U other, returns 1 if set grew
+int unionSets(CharSet *set, const CharSet *other) {
+    int grew = 0;
+    for (int k = 0; k < 4; k++) {
+        unsigned long long w = set->w[k] | other->w[k];
+        if (w != set->w[k]) {
+            set->w[k] = w;
+            grew = 1;
+        }
+    }
+    return grew;
 }
 
 int isNonTerminal(char c) {
@@ -36,65 +65,126 @@ int isNonTerminal(char c) {
 
 void splitProductions(char *input) {
     char lhs = input[0];
+    if (!isNonTerminal(lhs)) {
+        fprintf(stderr, "skipping %s: left side must be A..Z\n", input);
+        return;
+    }
     char *rhs = strtok(input + 2, "|"); // skip A=
     while (rhs != NULL) {
+        if (prodCnt == prodCap) {
+            prodCap = prodCap ? 2 * prodCap : MAX;
+            prod = realloc(prod, prodCap * sizeof(struct Productions));
+        }
         prod[prodCnt].lhs = lhs;
-        strcpy(prod[prodCnt].rhs, rhs);
+        prod[prodCnt].rhs = strdup(rhs);
         prodCnt++;
         rhs = strtok(NULL, "|");
     }
 }
 
-void computeFirst(char symbol, char* result) {
-    // 1. add self
-    if (!isNonTerminal(symbol)) {
-        addSymbol(result, symbol);
-        return;
+// Worklist propagation along subset edges: bit A of succ[B] means
+// sets[B] is part of sets[A]. A nonterminal is queued again only when its
+// set grows, and a set can only grow once per character, so left and
+// mutual recursion settle without any re-entry.
+void propagate(CharSet *sets, const unsigned int *succ) {
+    int queue[NT], queued[NT];
+    int head = 0, count = 0;
+    for (int b = 0; b < NT; b++) {
+        queue[count++] = b;
+        queued[b] = 1;
     }
+    while (count > 0) {
+        int b = queue[head];
+        head = (head + 1) % NT;
+        count--;
+        queued[b] = 0;
+        for (unsigned int m = succ[b]; m; m &= m - 1) {
+            int a = __builtin_ctz(m);
+            if (unionSets(&sets[a], &sets[b]) && !queued[a]) {
+                queue[(head + count) % NT] = a;
+                count++;
+                queued[a] = 1;
+            }
+        }
+    }
+}
 
-    // 2. check cache
-    int index = symbol - 'A';
-    if (visitedFirst[index]) {
-        strcpy(result, firstSets[index]);
-        return;
+// A is nullable if some production of A has only nullable nonterminals
+// (or #) on the right. pending[i] counts the nonterminal occurrences of
+// production i not yet known to be nullable, or -1 if it has a terminal;
+// each nonterminal that becomes nullable visits only the productions it
+// occurs in.
+void computeNullable() {
+    int *pending = malloc((prodCnt + 1) * sizeof(int));
+    int occStart[NT + 1] = {0};
+    for (int i = 0; i < prodCnt; i++) {
+        pending[i] = 0;
+        for (char *c = prod[i].rhs; *c; c++) {
+            if (*c == '#') continue;
+            if (!isNonTerminal(*c)) {
+                pending[i] = -1;
+                break;
+            }
+            pending[i]++;
+        }
+        if (pending[i] > 0)
+            for (char *c = prod[i].rhs; *c; c++)
+                if (*c != '#') occStart[*c - 'A' + 1]++;
+    }
+    for (int b = 0; b < NT; b++) occStart[b + 1] += occStart[b];
+    // productions of each nonterminal's occurrences, one entry per occurrence
+    int *occProd = malloc((occStart[NT] + 1) * sizeof(int));
+    int fill[NT];
+    memcpy(fill, occStart, sizeof(fill));
+    for (int i = 0; i < prodCnt; i++) {
+        if (pending[i] <= 0) continue;
+        for (char *c = prod[i].rhs; *c; c++)
+            if (*c != '#') occProd[fill[*c - 'A']++] = i;
     }
-    visitedFirst[index]=1;
 
-    // for all prods - add first
+    int queue[NT], count = 0;
     for (int i = 0; i < prodCnt; i++) {
-        if (prod[i].lhs == symbol) {
-            // null transitions
-            if (prod[i].rhs[0] == '#') {
-                addSymbol(result, '#');
+        int a = prod[i].lhs - 'A';
+        if (pending[i] == 0 && !nullable[a]) {
+            nullable[a] = 1;
+            queue[count++] = a;
+        }
+    }
+    while (count > 0) {
+        int b = queue[--count];
+        for (int k = occStart[b]; k < occStart[b + 1]; k++) {
+            int i = occProd[k];
+            int a = prod[i].lhs - 'A';
+            if (--pending[i] == 0 && !nullable[a]) {
+                nullable[a] = 1;
+                queue[count++] = a;
             }
-            else {
-                int j = 0;
-                // ε is #
-                // Eg: S->ABC
-                // FIRST(A)={a,#}
-                // FIRST(B)={b}
-
-                // get first(A) and store in temp
-                // add all symbols of temp to result
-                // if temp has #, then we have to add first(B), else we can stop
-                // If we reach the end of RHS (means every symbol so far produced ε),
-                // -> then the entire production can produce ε.
-                while (prod[i].rhs[j] != '\0') {
-                    char temp[MAX] = "";
-                    computeFirst(prod[i].rhs[j], temp);
-                    for (int t = 0; temp[t] != '\0'; t++) {
-                        if (temp[t] != '#') addSymbol(result, temp[t]);
-                    }
-                    // is # not in temp -- we can stop no need to check further
-                    if (strchr(temp, '#') == NULL) break;
-                    j++;
-                    // only reached if every prodn so far reached #
-                    if (prod[i].rhs[j] == '\0') addSymbol(result, '#');
-                }
+        }
+    }
+    free(pending);
+    free(occProd);
+}
+
+// FIRST(A) gets every terminal after a nullable prefix of a rhs of A, and
+// FIRST(B) for every nonterminal B in that position; # is added last for
+// nullable A so it does not spread
+void computeFirst() {
+    unsigned int succ[NT] = {0};
+    for (int i = 0; i < prodCnt; i++) {
+        int a = prod[i].lhs - 'A';
+        for (char *c = prod[i].rhs; *c; c++) {
+            if (*c == '#') continue;
+            if (!isNonTerminal(*c)) {
+                addSymbol(&firstSets[a], *c);
+                break;
             }
+            succ[*c - 'A'] |= 1u << a;
+            if (!nullable[*c - 'A']) break;
         }
     }
-    strcpy(firstSets[index], result);
+    propagate(firstSets, succ);
+    for (int a = 0; a < NT; a++)
+        if (nullable[a]) addSymbol(&firstSets[a], '#');
 }
 // E= T R
 // R= + T R | #
@@ -102,76 +192,494 @@ void computeFirst(char symbol, char* result) {
 // Y= * F Y | #
 // F= ( E ) | i
 
-void computeFollow(char symbol, char* result) {
-    int index = symbol - 'A';
-    // 1. check cache
-    if (visitedFollow[index]) {
-        strcpy(result, followSets[index]);
-        return;
+// FOLLOW(X) gets FIRST of what follows X in a rhs, minus #, and FOLLOW
+// of the lhs when that can vanish. Each rhs is scanned once right to left,
+// carrying FIRST of the suffix and whether it is nullable.
+void computeFollow() {
+    unsigned int succ[NT] = {0};
+    // start symbol gets $
+    addSymbol(&followSets[prod[0].lhs - 'A'], '$');
+    for (int i = 0; i < prodCnt; i++) {
+        int a = prod[i].lhs - 'A';
+        CharSet trailer = {{0}};
+        int tailNullable = 1;
+        for (int j = strlen(prod[i].rhs) - 1; j >= 0; j--) {
+            char c = prod[i].rhs[j];
+            if (c == '#') continue;
+            if (!isNonTerminal(c)) {
+                memset(&trailer, 0, sizeof(trailer));
+                addSymbol(&trailer, c);
+                tailNullable = 0;
+                continue;
+            }
+            int b = c - 'A';
+            unionSets(&followSets[b], &trailer);
+            if (tailNullable && b != a) succ[a] |= 1u << b;
+            CharSet first = firstSets[b];
+            removeSymbol(&first, '#');
+            if (nullable[b]) {
+                unionSets(&trailer, &first);
+            } else {
+                trailer = first;
+                tailNullable = 0;
+            }
+        }
     }
-    visitedFollow[index] = 1;
+    propagate(followSets, succ);
+}
 
-    // 2. X is start symbol add $
-    if (symbol == prod[0].lhs) addSymbol(result, '$');
+// The analysis cache (grammar_cache.h) is keyed by the productions, one
+// symbol per character with # dropped, so a grammar slr_real splits the
+// same way shares its entry.
+void grammarKey(GrammarKey *key) {
+    for (int i = 0; i < prodCnt; i++) {
+        gcache_key_sym(key, &prod[i].lhs, 1);
+        for (char *c = prod[i].rhs; *c; c++)
+            if (*c != '#') gcache_key_sym(key, c, 1);
+        gcache_key_end(key);
+    }
+}
 
-    // 3. check in each production
+// nullable, FIRST and FOLLOW from cached facts, 0 if every symbol is a
+// single character
+int loadFacts(const GrammarFacts *g) {
+    for (int t = 0; t < g->nterm; t++)
+        if (strlen(g->term[t]) != 1) return -1;
+    for (int a = 0; a < g->nnon; a++)
+        if (strlen(g->non[a]) != 1 || !isNonTerminal(g->non[a][0])) return -1;
+    for (int a = 0; a < g->nnon; a++) {
+        int b = g->non[a][0] - 'A';
+        nullable[b] = g->nullable[a];
+        for (int t = 0; t < g->nterm; t++) {
+            if ((GCACHE_FIRST(g, a)[t / 64] >> (t % 64)) & 1) addSymbol(&firstSets[b], g->term[t][0]);
+            if ((GCACHE_FOLLOW(g, a)[t / 64] >> (t % 64)) & 1) addSymbol(&followSets[b], g->term[t][0]);
+        }
+        if (nullable[b]) addSymbol(&firstSets[b], '#');
+    }
+    return 0;
+}
+
+// the computed sets as facts: terminals are the characters on the right
+// and $, nonterminals every letter used
+void storeFacts(GrammarFacts *g) {
+    CharSet used = {{0}};
+    char term[257];
+    int nterm = 0, nnon = 0;
+    addSymbol(&used, '#');
+    for (int i = 0; i < prodCnt; i++) {
+        for (char *c = prod[i].rhs; *c; c++) {
+            if (isNonTerminal(*c) || hasSymbol(&used, *c)) continue;
+            addSymbol(&used, *c);
+            term[nterm++] = *c;
+        }
+    }
+    if (!hasSymbol(&used, '$')) term[nterm++] = '$';
+    int letter[NT] = {0};
     for (int i = 0; i < prodCnt; i++) {
-        // if symbol not in prod.rhs skip prod
-        if (strchr(prod[i].rhs, symbol) == NULL) continue;
-
-        int j = 0;
-        // 4.check in rhs
-        while (prod[i].rhs[j] != '\0') {
-            // locate our symbol
-            if (prod[i].rhs[j] == symbol) {
-                // R#1: X is at end - add followset of lhs
-                if (prod[i].rhs[j + 1] == '\0') {
-                    // R#1.1: if X is at end and LHS is also X - skip it
-                    if (prod[i].lhs == symbol) {
-                        j++;
-                        continue;
-                    } 
-
-                    char temp[MAX] = "";
-                    computeFollow(prod[i].lhs, temp);
-                    for (int t = 0; t < strlen(temp); t++) addSymbol(result, temp[t]);
-                }
-                // R#2: X is followed by terminal next - add terminal
-                else if (!isNonTerminal(prod[i].rhs[j + 1])) {
-                    addSymbol(result, prod[i].rhs[j + 1]);
-                }
-                // R#3: X is followed by nonterminal NEXT - add first(next)- {ε}
-                else {
-                    int nextSymbolHasNULLInFirstSet = 0;
-                    
-                    // temp = FIRST(next) – {ε}
-                    char temp[MAX] = "";
-                    computeFirst(prod[i].rhs[j + 1], temp);
-                    for (int t = 0; t < strlen(temp); t++) {
-                        if (temp[t] != '#') addSymbol(result, temp[t]);
-                        else nextSymbolHasNULLInFirstSet = 1;
-                    }
-
-                    // R#3.1: X is followed by NEXT that ⇒ ε -> add follow of lhs
-                    if (nextSymbolHasNULLInFirstSet) {
-                        char temp[MAX] = "";
-                        if (prod[i].lhs == symbol) {
-                            j++;
-                            continue;
-                        } 
-                        computeFollow(prod[i].lhs, temp);
-                        for (int t = 0; t < strlen(temp); t++) addSymbol(result, temp[t]);
-                    }
-                }      
+        letter[prod[i].lhs - 'A'] = 1;
+        for (char *c = prod[i].rhs; *c; c++)
+            if (isNonTerminal(*c)) letter[*c - 'A'] = 1;
+    }
+    for (int b = 0; b < NT; b++) nnon += letter[b];
+
+    gcache_facts_init(g, nterm, nnon);
+    for (int t = 0; t < nterm; t++) g->term[t] = strndup(&term[t], 1);
+    int a = 0;
+    for (int b = 0; b < NT; b++) {
+        if (!letter[b]) continue;
+        char name = 'A' + b;
+        g->non[a] = strndup(&name, 1);
+        g->nullable[a] = nullable[b];
+        for (int t = 0; t < nterm; t++) {
+            if (hasSymbol(&firstSets[b], term[t])) GCACHE_FIRST(g, a)[t / 64] |= 1ULL << (t % 64);
+            if (hasSymbol(&followSets[b], term[t])) GCACHE_FOLLOW(g, a)[t / 64] |= 1ULL << (t % 64);
+        }
+        a++;
+    }
+}
+
+// all sets together: nullable, then FIRST, then FOLLOW, unless the cache
+// in $GRAMMAR_CACHE already has them
+void analyzeGrammar() {
+    GrammarKey key = {0};
+    GrammarFacts facts = {0};
+    int hit = 0;
+    if (gcache_enabled()) {
+        grammarKey(&key);
+        if (gcache_load(&key, &facts) == 0) {
+            hit = loadFacts(&facts) == 0;
+            gcache_facts_free(&facts);
+        }
+    }
+    if (!hit) {
+        computeNullable();
+        computeFirst();
+        computeFollow();
+        if (gcache_enabled()) {
+            storeFacts(&facts);
+            gcache_store(&key, &facts);
+            gcache_facts_free(&facts);
+        }
+    }
+    gcache_key_free(&key);
+}
+
+// FIRST_k and FOLLOW_k (-k N). A set of terminal strings of length <= k
+// is a trie: siblings are kept sorted by symbol, and end marks a node where
+// a string stops, so strings sharing a prefix share its nodes. Set tries
+// live in one pool, the intermediate results of a production in a scratch
+// pool emptied after it; nodes are referred to by index, as pools move
+// when they grow. Every node of a set trie leads to an end.
+typedef struct {
+    unsigned char sym;
+    char end;
+    int child, next;    // first child, next sibling, -1 if none
+} TrieNode;
+
+typedef struct {
+    TrieNode *node;
+    int len, cap;
+    int peak;
+} TriePool;
+
+TriePool sets, scratch;
+int lookK = 1;     // the k of FIRST_k/FOLLOW_k
+int firstRoot[NT], followRoot[NT];
+
+int trieNode(TriePool *p, unsigned char sym) {
+    if (p->len == p->cap) {
+        p->cap = p->cap ? 2 * p->cap : 1024;
+        p->node = realloc(p->node, p->cap * sizeof(TrieNode));
+    }
+    TrieNode *n = &p->node[p->len];
+    n->sym = sym;
+    n->end = 0;
+    n->child = n->next = -1;
+    if (p->len + 1 > p->peak) p->peak = p->len + 1;
+    return p->len++;
+}
+
+// child of r on sym, added (in order) if missing
+int trieChild(TriePool *p, int r, unsigned char sym, int *grew) {
+    int prev = -1, c = p->node[r].child;
+    while (c != -1 && p->node[c].sym < sym) {
+        prev = c;
+        c = p->node[c].next;
+    }
+    if (c != -1 && p->node[c].sym == sym) return c;
+    int n = trieNode(p, sym);
+    p->node[n].next = c;
+    if (prev == -1) p->node[r].child = n;
+    else p->node[prev].next = n;
+    *grew = 1;
+    return n;
+}
+
+void trieEnd(TriePool *p, int r, int *grew) {
+    if (!p->node[r].end) {
+        p->node[r].end = 1;
+        *grew = 1;
+    }
+}
+
+int trieEmpty(const TriePool *p, int r) {
+    return !p->node[r].end && p->node[r].child == -1;
+}
+
+// add the strings below src node b, cut to left symbols, below dst node r
+void trieGraft(TriePool *dst, int r, const TriePool *src, int b, int left, int *grew) {
+    if (src->node[b].end || (left == 0 && src->node[b].child != -1)) trieEnd(dst, r, grew);
+    if (left == 0) return;
+    for (int c = src->node[b].child; c != -1; c = src->node[c].next) {
+        int rc = trieChild(dst, r, src->node[c].sym, grew);
+        trieGraft(dst, rc, src, c, left - 1, grew);
+    }
+}
+
+// below dst node out: x y cut to k, for x in the trie at a and y in the
+// trie at b. x of full length is kept even when b is empty, as for k = 1.
+void concatWalk(TriePool *dst, int out, const TriePool *pa, int a, const TriePool *pb, int b,
+                unsigned char *path, int depth, int *grew) {
+    if (pa->node[a].end && (depth == lookK || !trieEmpty(pb, b))) {
+        int r = out;
+        for (int d = 0; d < depth; d++) r = trieChild(dst, r, path[d], grew);
+        if (depth == lookK) trieEnd(dst, r, grew);
+        else trieGraft(dst, r, pb, b, lookK - depth, grew);
+    }
+    if (depth == lookK) return;
+    for (int c = pa->node[a].child; c != -1; c = pa->node[c].next) {
+        path[depth] = pa->node[c].sym;
+        concatWalk(dst, out, pa, c, pb, b, path, depth + 1, grew);
+    }
+}
+
+// add the strings of the trie at r shorter than left symbols below node t
+void trieCopyShort(TriePool *dst, int t, const TriePool *src, int r, unsigned char *path, int depth, int left) {
+    if (left == 0) return;
+    if (src->node[r].end) {
+        int grew = 0, x = t;
+        for (int d = 0; d < depth; d++) x = trieChild(dst, x, path[d], &grew);
+        trieEnd(dst, x, &grew);
+    }
+    for (int c = src->node[r].child; c != -1; c = src->node[c].next) {
+        path[depth] = src->node[c].sym;
+        trieCopyShort(dst, t, src, c, path, depth + 1, left - 1);
+    }
+}
+
+// new scratch trie holding the scratch trie at prefix . FIRST_k(X)
+int appendSymbol(int prefix, char X) {
+    unsigned char path[lookK + 1];
+    int grew = 0;
+    int out = trieNode(&scratch, 0);
+    if (isNonTerminal(X)) {
+        concatWalk(&scratch, out, &scratch, prefix, &sets, firstRoot[X - 'A'], path, 0, &grew);
+    } else {
+        int x = trieNode(&scratch, 0);
+        trieEnd(&scratch, trieChild(&scratch, x, X, &grew), &grew);
+        concatWalk(&scratch, out, &scratch, prefix, &scratch, x, path, 0, &grew);
+    }
+    return out;
+}
+
+// Adds the k-long strings of FIRST_k(str) to the set trie at root and
+// returns a scratch trie with the shorter ones, which the rest of str
+// extends symbol by symbol while there are any. If str starts with a
+// nonterminal X, the k-long strings of FIRST_k(X) are added only when bit
+// X of *lead is clear, then the bit is set: callers adding many strings
+// with the same first symbol to one set do that part once.
+int firstInto(const char *str, int root, unsigned int *lead, int *grew) {
+    unsigned char path[lookK + 1];
+    int none = trieNode(&scratch, 0);
+    int cur = trieNode(&scratch, 0);
+    int added = 0, atStart = 1;
+    trieEnd(&scratch, cur, &added);
+    for (const char *c = str; *c && !trieEmpty(&scratch, cur); c++) {
+        if (*c == '#') continue;
+        const TriePool *src = &scratch;
+        int r;
+        if (atStart && isNonTerminal(*c)) {
+            int x = *c - 'A';
+            src = &sets;
+            r = firstRoot[x];
+            if (!((*lead >> x) & 1)) {
+                concatWalk(&sets, root, &sets, r, &scratch, none, path, 0, grew);
+                *lead |= 1u << x;
+            }
+        } else {
+            r = appendSymbol(cur, *c);
+            concatWalk(&sets, root, &scratch, r, &scratch, none, path, 0, grew);
+        }
+        atStart = 0;
+        cur = trieNode(&scratch, 0);
+        trieCopyShort(&scratch, cur, src, r, path, 0, lookK);
+    }
+    return cur;
+}
+
+// productions grouped by lhs: byLhs[lhsStart[A]..lhsStart[A+1])
+int lhsStart[NT + 1];
+int *byLhs;
+
+void groupByLhs() {
+    memset(lhsStart, 0, sizeof(lhsStart));
+    for (int i = 0; i < prodCnt; i++) lhsStart[prod[i].lhs - 'A' + 1]++;
+    for (int a = 0; a < NT; a++) lhsStart[a + 1] += lhsStart[a];
+    int fill[NT];
+    memcpy(fill, lhsStart, sizeof(fill));
+    byLhs = malloc((prodCnt + 1) * sizeof(int));
+    for (int i = 0; i < prodCnt; i++) byLhs[fill[prod[i].lhs - 'A']++] = i;
+}
+
+// worklist over nonterminals: run update(A) for every queued A; update
+// returns the nonterminals to queue as a mask
+void runWorklist(unsigned int (*update)(int)) {
+    int queue[NT], queued[NT];
+    int head = 0, count = 0;
+    for (int a = 0; a < NT; a++) {
+        queue[count++] = a;
+        queued[a] = 1;
+    }
+    while (count > 0) {
+        int a = queue[head];
+        head = (head + 1) % NT;
+        count--;
+        queued[a] = 0;
+        for (unsigned int m = update(a); m; m &= m - 1) {
+            int b = __builtin_ctz(m);
+            if (!queued[b]) {
+                queue[(head + count) % NT] = b;
+                count++;
+                queued[b] = 1;
+            }
+        }
+    }
+}
+
+// users[B]: nonterminals with B anywhere on a right side
+unsigned int users[NT];
+
+// FIRST_k(A) = union over A->X1..Xn of FIRST_k(X1) . ... . FIRST_k(Xn)
+unsigned int updateFirstK(int a) {
+    unsigned int lead = 0;
+    int grew = 0;
+    for (int q = lhsStart[a]; q < lhsStart[a + 1]; q++) {
+        int rest = firstInto(prod[byLhs[q]].rhs, firstRoot[a], &lead, &grew);
+        trieGraft(&sets, firstRoot[a], &scratch, rest, lookK, &grew);
+        scratch.len = 0;
+    }
+    return grew ? users[a] : 0;
+}
+
+// For A->alpha B beta, FOLLOW_k(B) gets FIRST_k(beta) . FOLLOW_k(A).
+// FIRST_k(beta) is worked out once: its strings of length k go straight
+// into FOLLOW_k(B), and the shorter ones join the tail of the edge A -> B,
+// along which FOLLOW_k(A) flows on every change. All occurrences of B in
+// rhs of A share one edge, as the concatenation distributes over union.
+typedef struct {
+    int b, tail;    // tail: trie in the tails pool
+} FollowEdge;
+
+TriePool tails;
+FollowEdge edges[NT * NT];
+int edgeStart[NT + 1];
+
+void buildFollowEdges() {
+    unsigned char path[lookK + 1];
+    int tailOf[NT][NT];
+    memset(tailOf, -1, sizeof(tailOf));
+    unsigned int lead[NT] = {0};    // per FOLLOW_k(B), as in firstInto
+    for (int i = 0; i < prodCnt; i++) {
+        const char *rhs = prod[i].rhs;
+        int a = prod[i].lhs - 'A';
+        for (int j = 0; rhs[j]; j++) {
+            if (!isNonTerminal(rhs[j])) continue;
+            int b = rhs[j] - 'A', grew = 0;
+            int rest = firstInto(rhs + j + 1, followRoot[b], &lead[b], &grew);
+            if (!trieEmpty(&scratch, rest)) {
+                if (tailOf[a][b] == -1) tailOf[a][b] = trieNode(&tails, 0);
+                trieCopyShort(&tails, tailOf[a][b], &scratch, rest, path, 0, lookK);
             }
-            j++;
+            scratch.len = 0;
+        }
+    }
+    int n = 0;
+    for (int a = 0; a < NT; a++) {
+        edgeStart[a] = n;
+        for (int b = 0; b < NT; b++) {
+            int t = tailOf[a][b];
+            // FOLLOW_k(A) into itself adds nothing new
+            if (t == -1 || (a == b && tails.node[t].child == -1)) continue;
+            edges[n].b = b;
+            edges[n].tail = t;
+            n++;
         }
     }
-    strcpy(followSets[index], result);
+    edgeStart[NT] = n;
+}
+
+unsigned int updateFollowK(int a) {
+    unsigned char path[lookK + 1];
+    unsigned int changed = 0;
+    for (int e = edgeStart[a]; e < edgeStart[a + 1]; e++) {
+        int b = edges[e].b, grew = 0;
+        int out = trieNode(&scratch, 0);
+        concatWalk(&scratch, out, &tails, edges[e].tail, &sets, followRoot[a], path, 0, &grew);
+        grew = 0;
+        trieGraft(&sets, followRoot[b], &scratch, out, lookK, &grew);
+        if (grew) changed |= 1u << b;
+        scratch.len = 0;
+    }
+    return changed;
+}
+
+// strings in the trie at r, and the symbols they would take stored one
+// by one with a terminator
+void trieCount(const TriePool *p, int r, int depth, long *strings, long *flat) {
+    if (p->node[r].end) {
+        (*strings)++;
+        *flat += depth + 1;
+    }
+    for (int c = p->node[r].child; c != -1; c = p->node[c].next) trieCount(p, c, depth + 1, strings, flat);
+}
+
+double nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+void computeFirstFollowK() {
+    groupByLhs();
+    for (int i = 0; i < prodCnt; i++)
+        for (char *c = prod[i].rhs; *c; c++)
+            if (isNonTerminal(*c)) users[*c - 'A'] |= 1u << (prod[i].lhs - 'A');
+    for (int a = 0; a < NT; a++) {
+        firstRoot[a] = trieNode(&sets, 0);
+        followRoot[a] = trieNode(&sets, 0);
+    }
+    double t0 = nowMs();
+    runWorklist(updateFirstK);
+    double t1 = nowMs();
+    // the start symbol is followed by the end marker
+    int grew = 0;
+    trieEnd(&sets, trieChild(&sets, followRoot[prod[0].lhs - 'A'], '$', &grew), &grew);
+    buildFollowEdges();
+    runWorklist(updateFollowK);
+    double t2 = nowMs();
+
+    long strings = 0, flat = 0;
+    for (int i = 0; i < nonTermCnt; i++) {
+        trieCount(&sets, firstRoot[nonTerminals[i] - 'A'], 0, &strings, &flat);
+        trieCount(&sets, followRoot[nonTerminals[i] - 'A'], 0, &strings, &flat);
+    }
+    printf("k=%d: FIRST_k %.3f ms, FOLLOW_k %.3f ms; %ld strings in %d trie nodes (%zu bytes, "
+           "%ld symbols stored one by one); %d edge tail nodes, scratch peak %d nodes (%zu bytes)\n",
+           lookK, t1 - t0, t2 - t1, strings, sets.len, sets.len * sizeof(TrieNode), flat,
+           tails.len, scratch.peak, (tails.len + scratch.peak) * sizeof(TrieNode));
+}
+
+// strings of the trie at r in order, # for the empty string
+void printTrie(const TriePool *p, int r, char *path, int depth, int *printed) {
+    if (p->node[r].end) {
+        if ((*printed)++) printf(" ");
+        if (depth == 0) printf("#");
+        else printf("%.*s", depth, path);
+    }
+    for (int c = p->node[r].child; c != -1; c = p->node[c].next) {
+        path[depth] = p->node[c].sym;
+        printTrie(p, c, path, depth + 1, printed);
+    }
+}
+
+void printSetK(int root) {
+    char path[lookK + 1];
+    int printed = 0;
+    printTrie(&sets, root, path, 0, &printed);
 }
 
-int main() {
-    char input[100];
+void printSet(const CharSet *set) {
+    int printed = 0;
+    for (int c = 1; c < 256; c++) {
+        if (!hasSymbol(set, c)) continue;
+        if (printed++) printf(" ");
+        printf("%c", c);
+    }
+}
+
+int main(int argc, char **argv) {
+    int useK = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-k") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            lookK = atoi(argv[++i]);
+            useK = 1;
+        } else {
+            fprintf(stderr, "usage: %s [-k N]   (FIRST_k/FOLLOW_k with timing and memory)\n", argv[0]);
+            fprintf(stderr, "GRAMMAR_CACHE=DIR keeps FIRST/FOLLOW of each grammar in DIR for later runs\n");
+            return 1;
+        }
+    }
+    char input[MAXLINE];
     printf("Enter productions (use # for epsilon, | for multiple RHS).\n");
     printf("Enter rules (empty line to stop):\n");
     while (1) {
@@ -182,42 +690,44 @@ int main() {
         if (strlen(input) > 0)
             splitProductions(input);
     }
+    if (prodCnt == 0) return 0;
 
     // Collect non terminals
     for (int i = 0; i < prodCnt; i++) {
         if (strchr(nonTerminals, prod[i].lhs) == NULL) nonTerminals[nonTermCnt++] = prod[i].lhs;
     }
 
-    // FIRST Sets
-    for (int i = 0; i < nonTermCnt; i++) {
-        char result[MAX] = "";
-        computeFirst(nonTerminals[i], result);
+    if (useK) {
+        computeFirstFollowK();
+        printf("FIRST_%d SETS: \n", lookK);
+        for (int i = 0; i < nonTermCnt; i++) {
+            printf("FIRST_%d(%c) = { ", lookK, nonTerminals[i]);
+            printSetK(firstRoot[nonTerminals[i]-'A']);
+            printf("}\n");
+        }
+        printf("FOLLOW_%d SETS: \n", lookK);
+        for (int i = 0; i < nonTermCnt; i++) {
+            printf("FOLLOW_%d(%c) = { ", lookK, nonTerminals[i]);
+            printSetK(followRoot[nonTerminals[i]-'A']);
+            printf("}\n");
+        }
+        return 0;
     }
 
+    analyzeGrammar();
+
     printf("FIRST SETS: \n");
     for (int i =0 ; i < nonTermCnt; i++) {
         printf("FIRST(%c) = { ", nonTerminals[i]);
-        for (int j = 0; j < strlen(firstSets[nonTerminals[i]-'A']); j++) {
-            if (j > 0) printf(" ");
-            printf("%c", firstSets[nonTerminals[i]-'A'][j]);
-        }
+        printSet(&firstSets[nonTerminals[i]-'A']);
         printf("}\n");
     }
 
-    // FOLLOW Sets
-    for (int i = 0; i < nonTermCnt; i++) {
-        char result[MAX] = "";
-        computeFollow(nonTerminals[i], result);
-    }
-
     printf("FOLLOW SETS: \n");
     for (int i =0 ; i < nonTermCnt; i++) {
         printf("FOLLOW(%c) = { ", nonTerminals[i]);
-        for (int j = 0; j < strlen(followSets[nonTerminals[i]-'A']); j++) {
-            if (j > 0) printf(" ");
-            printf("%c", followSets[nonTerminals[i]-'A'][j]);
-        }
+        printSet(&followSets[nonTerminals[i]-'A']);
         printf("}\n");
     }
     return 0;
-}
\ No newline at end of file
+}
@@ -1,28 +1,78 @@
 /* slr_real.c
    Simple SLR parser implementation with tabular parse trace.
    Assumptions:
-     - Non-terminals are uppercase letters A-Z
-     - Terminals are single characters except uppercase letters
-     - Epsilon = '#'
-     - Productions like A->aB
+     - Nonterminals are the names left of "->", of any length (E, E', expr);
+       an uppercase letter on the right with no productions is one too
+     - Terminals are the other symbols on the right, one character each;
+       with --word-terminals a run of lowercase letters, digits and _
+       (id, num) is one terminal instead
+     - Symbols may be separated by spaces; the longest nonterminal name wins
+     - Epsilon = '#' (an empty alternative, 'ε' or a lone e also work)
+     - Productions like A->aB or E'->+ T E'
+   Input strings are split into the grammar's terminals by longest match;
+   blanks between tokens are ignored.
+   Build: gcc slr_real.c -o slr_real -pthread
+          (add -DSLR_STATS for hot-path counters and phase times, dumped to
+          stderr as JSON at exit)
+   Usage:
+     ./slr_real            read grammar and input interactively
+     ./slr_real --grammar FILE   read the productions from FILE, one per line
+     ./slr_real --lalr     same, but build LALR(1) lookaheads instead of SLR FOLLOW sets
+     ./slr_real --word-terminals   read a run of [a-z0-9_] on the right as one terminal
+                                   (id, num) instead of one terminal per character
+     ./slr_real --table-stats   also report table bytes and parse speed, dense vs compressed
+     ./slr_real --unit-elim     bypass states that only reduce by a unit production (A->B),
+                                reporting reductions and parse speed before and after
+     ./slr_real --glr      keep every action of conflicted entries and parse along all of
+                           them on a graph-structured stack (interactive, --batch, --parse)
+     ./slr_real --tree     also build the parse tree during reductions and print it
+                           (with --batch, build one per line and count the nodes)
+     ./slr_real --compile FILE   read grammar, write finished tables to FILE
+     ./slr_real --parse FILE     map tables from FILE, parse each stdin line
+     ./slr_real --emit-cpp FILE  read grammar, write a direct-coded C++ parser to FILE
+     ./slr_real --batch FILE     read grammar, then parse every line of FILE without tracing
+                                 (also after --parse TABLES; --trace-every N traces every Nth line,
+                                 --threads N spreads lines over N threads, 0 = all cores)
+     ./slr_real --threads N      also build the LR(0) states on N threads (same numbering)
+     ./slr_real --edits FILE     read grammar, parse the document on FILE's first line, then
+                                 apply each further line "pos del text" as an edit, reparsing
+                                 incrementally (also after --parse TABLES)
+     ./slr_real --grammar-edits FILE   read grammar, then apply each line of FILE ("+ A->alpha"
+                                 adds, "- N" or "- A->alpha" removes a production), updating
+                                 the tables incrementally and checking against a full rebuild
+     ./slr_real --bench    time every construction phase on generated grammar families
+                           (expression ladders, right-recursive lists, wide alternations,
+                           nullable chains); prints tab-separated rows with states, items,
+                           per-phase ms, ns per item, table bytes and peak memory
+   With GRAMMAR_CACHE=DIR in the environment, nullable, FIRST and FOLLOW are
+   loaded from DIR when the same productions were analyzed before (by this
+   or print_first_follow) and stored there otherwise; see grammar_cache.h.
 */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "grammar_cache.h"
 
-#define MAXP 100    // max productions
-#define MAXRHS 50   // max rhs length
-#define MAXSYMS 128 // ASCII
-#define MAXITEMS 500
-#define MAXSTATES 200
-#define MAXCOL 128
 #define MAXSTR 256
 
 typedef struct {
-    char lhs;               // single nonterminal
-    char rhs[MAXRHS];       // string of rhs symbols, '#' for epsilon
+    int lhs;                // nonterminal symbol id
+    int *rhs;               // symbol ids
+    int len;                // rhs length, 0 for epsilon
+    char *name;             // lhs as written
+    char *alt;              // rhs as written, "#" for an empty alternative
 } Production;
 
 typedef struct {
@@ -30,501 +80,3814 @@ typedef struct {
     int dot;    // position of dot (0..len)
 } Item;
 
+// an LR(0) state is its sorted kernel, kept in the item arena; closure
+// items are recomputed from the kernel when needed (state_items())
 typedef struct {
-    Item items[MAXITEMS];
-    int nitems;
+    int kbase;              // first kernel item in item_arena
+    int nkernel;
+    unsigned hash;          // hash of the sorted kernel
 } ItemSet;
 
-Production prods[MAXP];
-int nprods = 0;
-char nonterms[26]; int nnon = 0;
-char terms[MAXCOL]; int nterm = 0;
+Production *prods;
+int nprods = 0, prod_cap = 0;
 int augmented_index = -1;
-char start_symbol = 0;
+int start_symbol = -1;
 
-ItemSet states[MAXSTATES];
-int nstates = 0;
+// Interned symbols with dense ids: terminals are 0..nterm-1 in order of
+// first appearance ($ last unless the grammar uses it), nonterminals
+// nterm..nsyms-1. Per-nonterminal arrays are indexed by NT(X).
+char **sym_name;
+int nsyms = 0, nterm = 0, nnon = 0;
+int eof_sym = -1;           // id of $
+int *sym_rank;              // position of each symbol in name order
+#define NT(X) ((X) - nterm)
 
-int goto_table[MAXSTATES][MAXCOL]; // index of state or -1
-int action_type[MAXSTATES][MAXCOL]; // 0 none, 1 shift, 2 reduce, 3 accept
-int action_val[MAXSTATES][MAXCOL]; // state or production index
+// kernels of all states back to back; states and the index grow with the grammar
+Item *item_arena;
+int arena_len = 0, arena_cap = 0;
+ItemSet *states;
+int nstates = 0, state_cap = 0;
+int *state_index;           // open-addressed, state number or -1, keyed by kernel hash
+int index_cap;
+#define KERNEL(s) (item_arena + states[s].kbase)
+
+// closure_prods row B: productions whose dot-0 item closure() adds for
+// nonterminal B, i.e. those of every nonterminal B derives in leftmost
+// position (B included); pwords 64-bit words per row
+uint64_t *closure_prods;
+int pwords;
+#define CLOSURE(B) (closure_prods + (size_t)(B) * pwords)
+
+// dense tables, one row per state sized to the symbol count
+int *goto_table;   // nsyms per row: index of state or -1
+int *action_type;  // nterm per row: 0 none, 1 shift, 2 reduce, 3 accept
+int *action_val;   // nterm per row: state or production index
+#define GOTO(s,X) goto_table[(size_t)(s) * nsyms + (X)]
+#define ACT_TYPE(s,t) action_type[(size_t)(s) * nterm + (t)]
+#define ACT_VAL(s,t) action_val[(size_t)(s) * nterm + (t)]
 
 // Follow sets
-int follow[MAXSYMS][MAXCOL]; // follow[A][t] = 1 if t in FOLLOW(A)
-int firstset[MAXSYMS][MAXCOL];
-int nullable[MAXSYMS];
+// FIRST/FOLLOW sets are bitsets over terminal ids, one row of twords words
+// per nonterminal: bit t of FOLLOW(A) is set if t in FOLLOW(A)
+int twords;
+uint64_t *follow, *firstset;
+char *nullable;             // per nonterminal
+#define FIRST(A) (firstset + (size_t)(A) * twords)
+#define FOLLOW(A) (follow + (size_t)(A) * twords)
 
-// helper: map char to index
-int cindex(char c){ return (int)(unsigned char)c; }
+double now_sec(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
 
-// string utility
-int contains(char *s, char ch){
-    for(int i=0;s[i];i++) if(s[i]==ch) return 1;
-    return 0;
+// Instrumentation, built in with -DSLR_STATS: counters on the hot paths of
+// the generator and the parsers, and wall-clock time per phase, written
+// to stderr as JSON at exit. Without it the macros expand to nothing.
+// Counters are kept per thread; workers fold theirs into the totals when
+// they finish. Phases nest: closure_sets is part of states, lalr of table.
+#ifdef SLR_STATS
+enum {
+    ST_CLOSURE_ROWS,        // closure bitset rows ORed into an item set
+    ST_CLOSURE_ITEMS,       // items produced by closures, kernels included
+    ST_GOTO_SETS,           // goto kernels built and looked up
+    ST_INDEX_PROBES,        // state index slots probed
+    ST_KERNEL_COMPARES,     // full kernel comparisons on a hash match
+    ST_STATES_ADDED,
+    ST_SET_NODES,           // FIRST/FOLLOW/LALR digraph nodes visited
+    ST_SET_UNIONS,          // set unions along relation edges
+    ST_SHIFTS,
+    ST_REDUCTIONS,
+    ST_ACTION_LOOKUPS,
+    ST_GOTO_LOOKUPS,
+    NSTAT
+};
+static const char *stat_name[NSTAT] = {
+    "closure_rows", "closure_items", "goto_sets", "index_probes", "kernel_compares",
+    "states_added", "set_nodes", "set_unions", "shifts", "reductions",
+    "action_lookups", "goto_lookups"
+};
+enum { PH_SYMBOLS, PH_FIRST, PH_FOLLOW, PH_CLOSURE_SETS, PH_STATES, PH_LALR, PH_TABLE,
+       PH_COMPRESS, PH_UNIT_ELIM, PH_PARSE, NPHASE };
+static const char *phase_name[NPHASE] = {
+    "symbols", "first", "follow", "closure_sets", "states", "lalr", "table",
+    "compress", "unit_elim", "parse"
+};
+_Thread_local long stat_count[NSTAT];
+long stat_total[NSTAT];
+pthread_mutex_t stat_lock = PTHREAD_MUTEX_INITIALIZER;
+double phase_sec[NPHASE];
+long phase_calls[NPHASE];
+
+void stats_flush(){
+    pthread_mutex_lock(&stat_lock);
+    for(int c=0;c<NSTAT;c++){ stat_total[c] += stat_count[c]; stat_count[c] = 0; }
+    pthread_mutex_unlock(&stat_lock);
+}
+
+void stats_dump(){
+    stats_flush();
+    fprintf(stderr, "{\"counters\": {");
+    for(int c=0;c<NSTAT;c++) fprintf(stderr, "%s\"%s\": %ld", c ? ", " : "", stat_name[c], stat_total[c]);
+    fprintf(stderr, "},\n \"phases\": {");
+    for(int ph=0;ph<NPHASE;ph++)
+        fprintf(stderr, "%s\"%s\": {\"ms\": %.3f, \"calls\": %ld}", ph ? ", " : "",
+                phase_name[ph], phase_sec[ph] * 1e3, phase_calls[ph]);
+    fprintf(stderr, "}}\n");
+}
+
+#define STAT(c) (stat_count[ST_##c]++)
+#define STAT_ADD(c, n) (stat_count[ST_##c] += (n))
+#define STATS_FLUSH() stats_flush()
+#define STATS_INIT() atexit(stats_dump)
+#define PHASE_BEGIN() double phase_t0 = now_sec()
+#define PHASE_END(ph) (phase_sec[PH_##ph] += now_sec() - phase_t0, phase_calls[PH_##ph]++)
+#else
+#define STAT(c) ((void)0)
+#define STAT_ADD(c, n) ((void)0)
+#define STATS_FLUSH() ((void)0)
+#define STATS_INIT() ((void)0)
+#define PHASE_BEGIN() ((void)0)
+#define PHASE_END(ph) ((void)0)
+#endif
+
+// bitset helpers
+void set_bit(uint64_t *b, int i){ b[i/64] |= (uint64_t)1 << (i%64); }
+int test_bit(const uint64_t *b, int i){ return (b[i/64] >> (i%64)) & 1; }
+void or_bits(uint64_t *dst, const uint64_t *src, int words){
+    for(int w=0;w<words;w++) dst[w] |= src[w];
+}
+// remove bit i, moving the bits above it down one
+void delete_bit(uint64_t *b, int words, int i){
+    int w = i/64, r = i%64;
+    uint64_t low = b[w] & (((uint64_t)1 << r) - 1);
+    b[w] = low | (r == 63 ? 0 : (b[w] >> (r+1)) << r);
+    for(int k=w+1;k<words;k++){ b[k-1] |= b[k] << 63; b[k] >>= 1; }
+}
+
+int is_nonterm(int X){ return X >= nterm; }
+
+// copy of s[0..n) without surrounding blanks
+char *trim_copy(const char *s, int n){
+    while(n > 0 && isspace((unsigned char)*s)){ s++; n--; }
+    while(n > 0 && isspace((unsigned char)s[n-1])) n--;
+    char *r = malloc(n + 1);
+    memcpy(r, s, n); r[n] = 0;
+    return r;
+}
+
+Production *new_production(){
+    if(nprods == prod_cap){
+        prod_cap = prod_cap ? 2*prod_cap : 64;
+        prods = realloc(prods, prod_cap * sizeof(Production));
+    }
+    Production *P = &prods[nprods++];
+    memset(P, 0, sizeof(*P));
+    return P;
 }
 
-// add production (splits | into separate productions)
+// add production (splits | into separate productions); alternatives are
+// kept as written until collect_symbols() splits them into symbols
 void add_production_line(char *line){
     // find lhs -> rhslist
-    char lhs = line[0];
-    start_symbol = start_symbol ? start_symbol : lhs;
-    if(nprods==0){
-        // will add augmented later
-    }
-    // find "->"
     char *arrow = strstr(line,"->");
     if(!arrow) return;
-    char *rhslist = arrow + 2;
+    char *name = trim_copy(line, arrow - line);
+    if(!*name){ free(name); return; }
     // split by '|'
-    char *p = rhslist;
-    char buffer[MAXSTR];
+    char *p = arrow + 2;
     while(*p){
         char *q = p;
-        int bi=0;
-        while(*q && *q!='|'){ buffer[bi++]=*q; q++; }
-        buffer[bi]=0;
-        // trim
-        int i=0; while(buffer[i]==' ') i++;
-        memmove(buffer, buffer+i, strlen(buffer+i)+1);
-        i=strlen(buffer)-1; while(i>=0 && buffer[i]==' ') buffer[i--]=0;
-        // add production
-        prods[nprods].lhs = lhs;
-        if(strlen(buffer)==0) strcpy(prods[nprods].rhs, "#"); else strcpy(prods[nprods].rhs, buffer);
-        nprods++;
+        while(*q && *q!='|') q++;
+        char *alt = trim_copy(p, q - p);
+        if(!*alt){ free(alt); alt = strdup("#"); }
+        Production *P = new_production();
+        P->name = strdup(name);
+        P->alt = alt;
         if(*q=='|') p = q+1; else break;
     }
+    free(name);
+}
+
+// symbol interner: names hashed (FNV-1a) into an open-addressed table of
+// entries; ids are assigned once all names are known
+typedef struct {
+    char *name;
+    int nt, idx;    // kind and index among symbols of that kind
+} SymEntry;
+
+SymEntry *sym_ent;
+int nent;
+int *sym_hash, hash_cap;
+
+int intern(const char *s, int n, int nt){
+    unsigned h = 2166136261u;
+    for(int i=0;i<n;i++) h = (h ^ (unsigned char)s[i]) * 16777619u;
+    for(h &= hash_cap-1; sym_hash[h] != -1; h = (h+1) & (hash_cap-1)){
+        SymEntry *e = &sym_ent[sym_hash[h]];
+        if((int)strlen(e->name) == n && memcmp(e->name, s, n) == 0) return sym_hash[h];
+    }
+    SymEntry *e = &sym_ent[nent];
+    e->name = malloc(n + 1);
+    memcpy(e->name, s, n); e->name[n] = 0;
+    e->nt = nt; e->idx = -1;
+    sym_hash[h] = nent;
+    return nent++;
+}
+
+// nonterminal names for longest-match splitting: a trie whose edges
+// (node, char) -> child live in an open-addressed hash, node 0 the root;
+// end[v] marks nodes where a name stops
+typedef struct {
+    int *edge_node, *edge_child;    // edge_node -1 for a free slot
+    unsigned char *edge_char;
+    int cap, nodes;
+    char *end;
+} NameTrie;
+
+// room for names of chars characters in total
+void trie_init(NameTrie *T, int chars){
+    T->cap = 16;
+    while(T->cap < 2*chars + 2) T->cap *= 2;
+    T->edge_node = malloc(T->cap * sizeof(int));
+    T->edge_child = malloc(T->cap * sizeof(int));
+    T->edge_char = malloc(T->cap);
+    for(int h=0;h<T->cap;h++) T->edge_node[h] = -1;
+    T->end = calloc(chars + 1, 1);
+    T->nodes = 1;
+}
+
+void trie_free(NameTrie *T){
+    free(T->edge_node); free(T->edge_child); free(T->edge_char); free(T->end);
+}
+
+unsigned trie_slot(const NameTrie *T, int v, unsigned char c){
+    unsigned h = ((unsigned)v * 257u + c) * 2654435761u;
+    return (h ^ (h >> 16)) & (T->cap - 1);
+}
+
+// child of v along c, or -1
+int trie_child(const NameTrie *T, int v, unsigned char c){
+    for(unsigned h = trie_slot(T, v, c); T->edge_node[h] != -1; h = (h+1) & (T->cap-1))
+        if(T->edge_node[h] == v && T->edge_char[h] == c) return T->edge_child[h];
+    return -1;
+}
+
+void trie_add(NameTrie *T, const char *s){
+    int v = 0;
+    for(;*s;s++){
+        int w = trie_child(T, v, *s);
+        if(w == -1){
+            unsigned h = trie_slot(T, v, *s);
+            while(T->edge_node[h] != -1) h = (h+1) & (T->cap-1);
+            T->edge_node[h] = v; T->edge_char[h] = *s; T->edge_child[h] = w = T->nodes++;
+        }
+        v = w;
+    }
+    T->end[v] = 1;
+}
+
+// length of the longest nonterminal name at s, 0 if none
+int match_nonterm(const NameTrie *T, const char *s){
+    int best = 0;
+    for(int v=0, i=0; s[i] && (v = trie_child(T, v, s[i])) != -1; i++)
+        if(T->end[v]) best = i + 1;
+    return best;
+}
+
+// is the alternative an epsilon spelling?
+int is_epsilon(const char *alt, const NameTrie *T){
+    if(strcmp(alt, "#") == 0 || strcmp(alt, "\xce\xb5") == 0) return 1;
+    return strcmp(alt, "e") == 0 && match_nonterm(T, "e") == 0;
+}
+
+// with --word-terminals a run of [a-z0-9_] is one terminal (id, num);
+// by default every character is
+int word_terminals = 0;
+
+// split an alternative into symbols: the longest nonterminal name, else an
+// uppercase letter, else a run of [a-z0-9_] (--word-terminals), else a
+// single character. Symbol k is s[off[k]..off[k]+len[k]), a nonterminal if
+// nt[k]; the arrays need strlen(s) entries. Returns the symbol count.
+int split_alt(const char *s, const NameTrie *T, int *off, int *len, char *nt){
+    int count = 0;
+    for(int i=0;s[i];){
+        if(isspace((unsigned char)s[i])){ i++; continue; }
+        int n = match_nonterm(T, s+i), isnt = 1;
+        if(n == 0){
+            isnt = isupper((unsigned char)s[i]) != 0;
+            n = 1;
+            if(word_terminals && (islower((unsigned char)s[i]) || isdigit((unsigned char)s[i]) || s[i] == '_'))
+                while(s[i+n] && (islower((unsigned char)s[i+n]) || isdigit((unsigned char)s[i+n]) || s[i+n] == '_')
+                      && !match_nonterm(T, s+i+n)) n++;
+        }
+        off[count] = i; len[count] = n; nt[count] = isnt; count++;
+        i += n;
+    }
+    return count;
 }
 
-// check and add non-terminals and terminals lists
+int name_cmp(const void *a, const void *b){
+    return strcmp(sym_name[*(const int *)a], sym_name[*(const int *)b]);
+}
+
+// split every alternative into symbols (split_alt()) and intern them.
+// Terminals then nonterminals are numbered in order of first appearance,
+// as the old character tables listed them.
 void collect_symbols(){
-    int seenNT[26]={0};
-    int seenT[MAXCOL]={0};
-    for(int i=0;i<nprods;i++){
-        if(prods[i].lhs>='A' && prods[i].lhs<='Z'){
-            if(!seenNT[prods[i].lhs-'A']){ nonterms[nnon++]=prods[i].lhs; seenNT[prods[i].lhs-'A']=1; }
-        }
-        for(int j=0;j<strlen(prods[i].rhs);j++){
-            char c = prods[i].rhs[j];
-            if(c=='#') continue;
-            if(c>='A' && c<='Z'){
-                if(!seenNT[c-'A']){ nonterms[nnon++]=c; seenNT[c-'A']=1; }
-            } else {
-                if(!seenT[(int)c]){ terms[nterm++]=c; seenT[(int)c]=1; }
-            }
+    PHASE_BEGIN();
+    int chars = 0, maxalt = 1;
+    for(int p=0;p<nprods;p++){
+        chars += strlen(prods[p].name) + strlen(prods[p].alt) + 2;
+        if((int)strlen(prods[p].alt) > maxalt) maxalt = strlen(prods[p].alt);
+    }
+    hash_cap = 64;
+    while(hash_cap < 2*chars + 4) hash_cap *= 2;
+    sym_hash = malloc(hash_cap * sizeof(int));
+    for(int h=0;h<hash_cap;h++) sym_hash[h] = -1;
+    sym_ent = malloc((chars + 2) * sizeof(SymEntry));
+    nent = 0;
+
+    // nonterminal names: every lhs, deduplicated by the interner
+    NameTrie T;
+    trie_init(&T, chars);
+    for(int p=0;p<nprods;p++){
+        int before = nent;
+        intern(prods[p].name, strlen(prods[p].name), 1);
+        if(nent > before) trie_add(&T, prods[p].name);
+    }
+
+    // rhs holds entry numbers until ids are assigned
+    int nt_count = 0, t_count = 0;
+    int *off = malloc(maxalt * sizeof(int)), *len = malloc(maxalt * sizeof(int));
+    char *nt = malloc(maxalt);
+    for(int p=0;p<nprods;p++){
+        Production *P = &prods[p];
+        P->lhs = intern(P->name, strlen(P->name), 1);
+        if(sym_ent[P->lhs].idx == -1) sym_ent[P->lhs].idx = nt_count++;
+        P->rhs = malloc((strlen(P->alt) + 1) * sizeof(int));
+        P->len = 0;
+        if(is_epsilon(P->alt, &T)) continue;
+        int n = split_alt(P->alt, &T, off, len, nt);
+        for(int k=0;k<n;k++){
+            int e = intern(P->alt + off[k], len[k], nt[k]);
+            if(sym_ent[e].idx == -1) sym_ent[e].idx = nt[k] ? nt_count++ : t_count++;
+            P->rhs[P->len++] = e;
         }
     }
+    trie_free(&T);
+    free(off); free(len); free(nt);
     // ensure $ is a terminal
-    if(!contains(terms,'$')) terms[nterm++] = '$';
+    int eof_ent = intern("$", 1, 0);
+    if(sym_ent[eof_ent].idx == -1) sym_ent[eof_ent].idx = t_count++;
+
+    nterm = t_count; nnon = nt_count; nsyms = nterm + nnon;
+    sym_name = malloc(nsyms * sizeof(char *));
+    int *ent_id = malloc(nent * sizeof(int));
+    for(int e=0;e<nent;e++){
+        ent_id[e] = sym_ent[e].nt ? nterm + sym_ent[e].idx : sym_ent[e].idx;
+        sym_name[ent_id[e]] = sym_ent[e].name;
+    }
+    for(int p=0;p<nprods;p++){
+        prods[p].lhs = ent_id[prods[p].lhs];
+        for(int k=0;k<prods[p].len;k++) prods[p].rhs[k] = ent_id[prods[p].rhs[k]];
+    }
+    eof_sym = ent_id[eof_ent];
+    start_symbol = prods[0].len ? prods[0].rhs[0] : prods[0].lhs;
+
+    // rank symbols by name so goto numbering matches the old code order
+    int *byname = malloc(nsyms * sizeof(int));
+    for(int X=0;X<nsyms;X++) byname[X] = X;
+    qsort(byname, nsyms, sizeof(int), name_cmp);
+    sym_rank = malloc(nsyms * sizeof(int));
+    for(int r=0;r<nsyms;r++) sym_rank[byname[r]] = r;
+    twords = (nterm + 63) / 64;
+
+    free(byname); free(ent_id);
+    free(sym_hash); free(sym_ent);
+    sym_hash = NULL; sym_ent = NULL;
+    PHASE_END(SYMBOLS);
 }
 
 // production length helper
 int prod_len(int idx){
-    if(prods[idx].rhs[0]=='#') return 0;
-    return strlen(prods[idx].rhs);
+    return prods[idx].len;
 }
 
-// item equality
-int item_equal(Item *a, Item *b){
-    return a->prod==b->prod && a->dot==b->dot;
+// precompute closure_prods once per grammar: Warshall over the
+// left-corner relation between nonterminals, then OR in each reachable
+// nonterminal's productions
+void compute_closure_sets(){
+    PHASE_BEGIN();
+    int nw = (nnon + 63) / 64;
+    pwords = (nprods + 63) / 64;
+    uint64_t *corner = calloc((size_t)nnon * nw, sizeof(uint64_t));
+    uint64_t *own = calloc((size_t)nnon * pwords, sizeof(uint64_t));
+    for(int B=0;B<nnon;B++) set_bit(corner + (size_t)B*nw, B);
+    for(int p=0;p<nprods;p++){
+        int B = NT(prods[p].lhs);
+        set_bit(own + (size_t)B*pwords, p);
+        if(prods[p].len && is_nonterm(prods[p].rhs[0])) set_bit(corner + (size_t)B*nw, NT(prods[p].rhs[0]));
+    }
+    for(int k=0;k<nnon;k++)
+        for(int B=0;B<nnon;B++)
+            if(test_bit(corner + (size_t)B*nw, k)) or_bits(corner + (size_t)B*nw, corner + (size_t)k*nw, nw);
+    free(closure_prods);
+    closure_prods = calloc((size_t)nnon * pwords, sizeof(uint64_t));
+    for(int B=0;B<nnon;B++)
+        for(int C=0;C<nnon;C++)
+            if(test_bit(corner + (size_t)B*nw, C)) or_bits(CLOSURE(B), own + (size_t)C*pwords, pwords);
+    free(corner); free(own);
+    PHASE_END(CLOSURE_SETS);
 }
 
-// add item if not present
-int add_item(ItemSet *S, Item it){
-    for(int i=0;i<S->nitems;i++) if(item_equal(&S->items[i], &it)) return 0;
-    S->items[S->nitems++] = it;
-    return 1;
+// kernel and closure items of state s into *buf (grown as needed), kernel
+// first: OR the precomputed sets of the nonterminals after the dot in the
+// kernel, then append one dot-0 item per production in the result.
+// Returns the item count.
+int state_items(int s, Item **buf, int *cap){
+    const Item *k = KERNEL(s);
+    int nk = states[s].nkernel, n = nk;
+    uint64_t mask[pwords];
+    memset(mask, 0, sizeof(mask));
+    for(int i=0;i<nk;i++){
+        if(k[i].dot < prod_len(k[i].prod)){
+            int B = prods[k[i].prod].rhs[k[i].dot];
+            if(is_nonterm(B)){ or_bits(mask, CLOSURE(NT(B)), pwords); STAT(CLOSURE_ROWS); }
+        }
+    }
+    for(int w=0;w<pwords;w++) n += __builtin_popcountll(mask[w]);
+    if(n > *cap){
+        *cap = n > 2 * *cap ? n : 2 * *cap;
+        *buf = realloc(*buf, *cap * sizeof(Item));
+    }
+    memcpy(*buf, k, nk * sizeof(Item));
+    n = nk;
+    for(int w=0;w<pwords;w++){
+        for(uint64_t m = mask[w]; m; m &= m-1){
+            Item newit; newit.prod = w*64 + __builtin_ctzll(m); newit.dot = 0;
+            // the initial kernel S'->.S is itself a dot-0 item
+            if(newit.prod == 0 && nk && k[0].prod == 0 && k[0].dot == 0) continue;
+            (*buf)[n++] = newit;
+        }
+    }
+    STAT_ADD(CLOSURE_ITEMS, n);
+    return n;
 }
 
-// closure
-void closure(ItemSet *I){
-    int changed = 1;
-    while(changed){
-        changed = 0;
-        for(int i=0;i<I->nitems;i++){
-            Item it = I->items[i];
-            int len = prod_len(it.prod);
-            if(it.dot < len){
-                char B = prods[it.prod].rhs[it.dot];
-                if(B>='A' && B<='Z'){
-                    // for each production B -> gamma, add B .-> gamma with dot 0
-                    for(int p=0;p<nprods;p++){
-                        if(prods[p].lhs == B){
-                            Item newit; newit.prod = p; newit.dot = 0;
-                            if(add_item(I, newit)) changed=1;
-                        }
-                    }
-                }
-            }
+// sort kernel items by (prod,dot) and hash them; two LR(0) item sets are
+// equal exactly when their kernels are, so the kernel is the state's key
+int item_cmp(const void *a, const void *b){
+    const Item *x = a, *y = b;
+    if(x->prod != y->prod) return x->prod - y->prod;
+    return x->dot - y->dot;
+}
+
+unsigned canon_kernel(Item *k, int n){
+    qsort(k, n, sizeof(Item), item_cmp);
+    unsigned h = 2166136261u; // FNV-1a over (prod,dot) pairs
+    for(int i=0;i<n;i++){
+        h = (h ^ (unsigned)k[i].prod) * 16777619u;
+        h = (h ^ (unsigned)k[i].dot) * 16777619u;
+    }
+    return h;
+}
+
+// find state index if one with this sorted kernel exists
+int find_state(const Item *k, int n, unsigned h){
+    for(unsigned i = h & (index_cap-1); state_index[i] != -1; i = (i+1) & (index_cap-1)){
+        int s = state_index[i];
+        STAT(INDEX_PROBES);
+        if(states[s].hash != h || states[s].nkernel != n) continue;
+        STAT(KERNEL_COMPARES);
+        if(memcmp(KERNEL(s), k, n * sizeof(Item)) == 0) return s;
+    }
+    return -1;
+}
+
+void index_state(int s){
+    unsigned i = states[s].hash & (index_cap-1);
+    while(state_index[i] != -1) i = (i+1) & (index_cap-1);
+    state_index[i] = s;
+}
+
+// append a new state: its kernel goes to the arena, its goto row is
+// cleared, and the index doubles once it is half full
+int add_state(const Item *k, int n, unsigned h){
+    if(arena_len + n > arena_cap){
+        arena_cap = arena_cap ? 2*arena_cap : 1024;
+        while(arena_cap < arena_len + n) arena_cap *= 2;
+        item_arena = realloc(item_arena, arena_cap * sizeof(Item));
+    }
+    if(nstates == state_cap){
+        state_cap = state_cap ? 2*state_cap : 64;
+        states = realloc(states, state_cap * sizeof(ItemSet));
+        goto_table = realloc(goto_table, (size_t)state_cap * nsyms * sizeof(int));
+    }
+    int s = nstates++;
+    STAT(STATES_ADDED);
+    memcpy(item_arena + arena_len, k, n * sizeof(Item));
+    states[s].kbase = arena_len; states[s].nkernel = n; states[s].hash = h;
+    arena_len += n;
+    for(int X=0;X<nsyms;X++) GOTO(s, X) = -1;
+    if(2 * nstates > index_cap){
+        index_cap *= 2;
+        state_index = realloc(state_index, index_cap * sizeof(int));
+        for(int i=0;i<index_cap;i++) state_index[i] = -1;
+        for(int t=0;t<nstates;t++) index_state(t);
+    } else index_state(s);
+    return s;
+}
+
+// goto on symbol X: k holds the n advanced kernel items; returns the
+// existing state with that kernel or adds it as a new state
+int goto_set(Item *k, int n){
+    STAT(GOTO_SETS);
+    unsigned h = canon_kernel(k, n);
+    int idx = find_state(k, n, h);
+    if(idx != -1) return idx;
+    return add_state(k, n, h);
+}
+
+// scratch space for expand_state(), kept across calls
+typedef struct {
+    Item *items, *moved;
+    int icap, mcap;
+    int *count, *start;     // nsyms+1 buckets
+    int *by_rank;           // symbol of each name rank
+} Expander;
+
+void expander_init(Expander *E){
+    memset(E, 0, sizeof(*E));
+    E->count = malloc((nsyms+1) * sizeof(int));
+    E->start = malloc((nsyms+1) * sizeof(int));
+    E->by_rank = malloc(nsyms * sizeof(int));
+    for(int X=0;X<nsyms;X++) E->by_rank[sym_rank[X]] = X;
+}
+
+void expander_free(Expander *E){
+    free(E->items); free(E->moved); free(E->count); free(E->start); free(E->by_rank);
+}
+
+// bucket the items of state i by the symbol after the dot, advanced over
+// it: the kernel of the goto on the symbol of name rank r is then
+// E->moved[E->start[r]..E->count[r]). With only set, just the symbols it
+// flags get buckets.
+void bucket_items(Expander *E, int i, const char *only){
+    int n = state_items(i, &E->items, &E->icap);
+    if(n > E->mcap){ E->mcap = E->icap; E->moved = realloc(E->moved, E->mcap * sizeof(Item)); }
+    // counting sort of advanced items by the symbol they moved over
+    int *count = E->count, *start = E->start;
+    memset(count, 0, (nsyms+1) * sizeof(int));
+    for(int k=0;k<n;k++){
+        Item it = E->items[k];
+        if(it.dot < prod_len(it.prod) && (!only || only[prods[it.prod].rhs[it.dot]]))
+            count[sym_rank[prods[it.prod].rhs[it.dot]]+1]++;
+    }
+    for(int r=0;r<nsyms;r++) count[r+1] += count[r];
+    memcpy(start, count, (nsyms+1) * sizeof(int));
+    for(int k=0;k<n;k++){
+        Item it = E->items[k];
+        if(it.dot >= prod_len(it.prod) || (only && !only[prods[it.prod].rhs[it.dot]])) continue;
+        int r = sym_rank[prods[it.prod].rhs[it.dot]];
+        E->moved[count[r]].prod = it.prod;
+        E->moved[count[r]].dot = it.dot + 1;
+        count[r]++;
+    }
+}
+
+// fill the goto row of state i: only symbols that actually occur are
+// tried, in name order so numbering is stable; targets not seen before
+// become new states. With only set, just the symbols it flags are tried.
+void expand_state(Expander *E, int i, const char *only){
+    bucket_items(E, i, only);
+    for(int r=0;r<nsyms;r++){
+        if(E->start[r] == E->count[r]) continue;
+        int j = goto_set(E->moved + E->start[r], E->count[r] - E->start[r]);
+        GOTO(i, E->by_rank[r]) = j;     // goto_set may move goto_table
+    }
+}
+
+// Parallel construction (--threads N). States are expanded a frontier at
+// a time, the frontier being the states the previous one created. Workers
+// claim chunks of it and, for each state, bucket its items, sort and hash
+// the kernel of every goto and look it up in the state index, which only
+// the merge writes. The merge then walks the frontier in order, state by
+// state and symbols in name order, adding the kernels no lookup found:
+// that is the order the sequential loop meets them in, so the numbering
+// is the same for any thread count. Small frontiers are expanded in place.
+int nthreads = 1;           // 0 = all cores; --batch uses it too
+
+#define FRONTIER_CHUNK 16   // states claimed at a time
+#define FRONTIER_MIN 64     // smaller frontiers are not handed out
+
+int thread_count(){
+    int nw = nthreads > 0 ? nthreads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    return nw < 1 ? 1 : nw;
+}
+
+typedef struct {
+    int sym, kbase, n;      // goto symbol, kernel at kern[kbase..kbase+n)
+    unsigned hash;
+    int target;             // state the lookup found, or -1
+} PendingGoto;
+
+typedef struct {
+    Expander E;
+    Item *kern;             // this frontier's goto kernels
+    int klen, kcap;
+    PendingGoto *go;
+    int ngo, gocap;
+} StateWorker;
+
+typedef struct {
+    StateWorker *W;
+    int nw;
+    pthread_t *tid;
+    pthread_barrier_t start, done;
+    int lo, hi, quit;       // frontier states lo..hi-1
+    atomic_int next;        // first state of the next unclaimed chunk
+    int *gw, *g0, *gn;      // per frontier state: worker, first goto, goto count
+    int fcap;
+} StatePool;
+
+StatePool spool;
+
+void frontier_state(int w, int s){
+    StateWorker *W = &spool.W[w];
+    Expander *E = &W->E;
+    bucket_items(E, s, NULL);
+    int f = s - spool.lo;
+    spool.gw[f] = w; spool.g0[f] = W->ngo;
+    for(int r=0;r<nsyms;r++){
+        int n = E->count[r] - E->start[r];
+        if(n == 0) continue;
+        if(W->klen + n > W->kcap){
+            W->kcap = W->kcap ? 2*W->kcap : 1024;
+            while(W->kcap < W->klen + n) W->kcap *= 2;
+            W->kern = realloc(W->kern, W->kcap * sizeof(Item));
+        }
+        if(W->ngo == W->gocap){
+            W->gocap = W->gocap ? 2*W->gocap : 256;
+            W->go = realloc(W->go, W->gocap * sizeof(PendingGoto));
         }
+        Item *k = W->kern + W->klen;
+        memcpy(k, E->moved + E->start[r], n * sizeof(Item));
+        PendingGoto *g = &W->go[W->ngo++];
+        g->sym = E->by_rank[r]; g->kbase = W->klen; g->n = n;
+        g->hash = canon_kernel(k, n);
+        g->target = find_state(k, n, g->hash);
+        STAT(GOTO_SETS);
+        W->klen += n;
     }
+    spool.gn[f] = W->ngo - spool.g0[f];
 }
 
-// goto on symbol X (char)
-ItemSet goto_set(ItemSet *I, char X){
-    ItemSet J; J.nitems = 0;
-    for(int i=0;i<I->nitems;i++){
-        Item it = I->items[i];
-        int len = prod_len(it.prod);
-        if(it.dot < len){
-            char a = prods[it.prod].rhs[it.dot];
-            if(a == X){
-                Item nit; nit.prod = it.prod; nit.dot = it.dot + 1;
-                add_item(&J, nit);
+void frontier_chunks(int w){
+    for(;;){
+        int lo = atomic_fetch_add(&spool.next, FRONTIER_CHUNK);
+        if(lo >= spool.hi) break;
+        int hi = lo + FRONTIER_CHUNK < spool.hi ? lo + FRONTIER_CHUNK : spool.hi;
+        for(int s=lo;s<hi;s++) frontier_state(w, s);
+    }
+}
+
+void *state_worker(void *arg){
+    int w = (int)(intptr_t)arg;
+    for(;;){
+        pthread_barrier_wait(&spool.start);
+        if(spool.quit) break;
+        frontier_chunks(w);
+        pthread_barrier_wait(&spool.done);
+    }
+    STATS_FLUSH();
+    return NULL;
+}
+
+// expand the frontier lo..nstates-1 on the pool, then merge
+void expand_frontier(int lo){
+    int hi = nstates;
+    if(hi - lo > spool.fcap){
+        spool.fcap = hi - lo;
+        spool.gw = realloc(spool.gw, spool.fcap * sizeof(int));
+        spool.g0 = realloc(spool.g0, spool.fcap * sizeof(int));
+        spool.gn = realloc(spool.gn, spool.fcap * sizeof(int));
+    }
+    for(int w=0;w<spool.nw;w++) spool.W[w].klen = spool.W[w].ngo = 0;
+    spool.lo = lo; spool.hi = hi;
+    atomic_store(&spool.next, lo);
+    pthread_barrier_wait(&spool.start);
+    frontier_chunks(0);
+    pthread_barrier_wait(&spool.done);
+    for(int s=lo;s<hi;s++){
+        int f = s - lo;
+        StateWorker *W = &spool.W[spool.gw[f]];
+        for(int i=spool.g0[f];i<spool.g0[f]+spool.gn[f];i++){
+            PendingGoto *g = &W->go[i];
+            int j = g->target;
+            if(j == -1){
+                // not there when looked up: maybe added by this merge
+                j = find_state(W->kern + g->kbase, g->n, g->hash);
+                if(j == -1) j = add_state(W->kern + g->kbase, g->n, g->hash);
             }
+            GOTO(s, g->sym) = j;
         }
     }
-    closure(&J);
-    return J;
 }
 
-// compare itemsets
-int itemset_equal(ItemSet *a, ItemSet *b){
-    if(a->nitems != b->nitems) return 0;
-    for(int i=0;i<a->nitems;i++){
-        int found=0;
-        for(int j=0;j<b->nitems;j++) if(item_equal(&a->items[i], &b->items[j])){ found=1; break;}
-        if(!found) return 0;
-    }
-    return 1;
+void pool_start(int nw){
+    memset(&spool, 0, sizeof(spool));
+    spool.nw = nw;
+    spool.W = calloc(nw, sizeof(StateWorker));
+    spool.tid = malloc(nw * sizeof(pthread_t));
+    for(int w=0;w<nw;w++) expander_init(&spool.W[w].E);
+    pthread_barrier_init(&spool.start, NULL, nw);
+    pthread_barrier_init(&spool.done, NULL, nw);
+    for(int w=1;w<nw;w++) pthread_create(&spool.tid[w], NULL, state_worker, (void *)(intptr_t)w);
 }
 
-// find state index if equal exists
-int find_state(ItemSet *S){
-    for(int i=0;i<nstates;i++){
-        if(itemset_equal(S, &states[i])) return i;
+void pool_stop(){
+    spool.quit = 1;
+    pthread_barrier_wait(&spool.start);
+    for(int w=1;w<spool.nw;w++) pthread_join(spool.tid[w], NULL);
+    for(int w=0;w<spool.nw;w++){
+        expander_free(&spool.W[w].E);
+        free(spool.W[w].kern); free(spool.W[w].go);
     }
-    return -1;
+    pthread_barrier_destroy(&spool.start); pthread_barrier_destroy(&spool.done);
+    free(spool.W); free(spool.tid); free(spool.gw); free(spool.g0); free(spool.gn);
 }
 
-// generate canonical collection of LR(0) items
+// generate canonical collection of LR(0) items with a worklist: every state
+// is expanded once, in creation order (a frontier at a time with threads)
 void build_states(){
+    PHASE_BEGIN();
+    compute_closure_sets();
+    nstates = 0; arena_len = 0;
+    free(state_index);
+    index_cap = 64;
+    state_index = malloc(index_cap * sizeof(int));
+    for(int i=0;i<index_cap;i++) state_index[i] = -1;
+    // goto rows are reallocated to the new symbol count
+    free(goto_table); goto_table = NULL;
+    free(states); states = NULL; state_cap = 0;
     // initial item S'->.S (we added augmented production at index 0)
-    ItemSet I0; I0.nitems=0;
-    Item it0; it0.prod = 0; it0.dot = 0; add_item(&I0, it0);
-    closure(&I0);
-    states[0] = I0; nstates = 1;
+    Item it0; it0.prod = 0; it0.dot = 0;
+    goto_set(&it0, 1);
 
-    int changed = 1;
-    while(changed){
-        changed = 0;
-        for(int i=0;i<nstates;i++){
-            // for every grammar symbol X (nonterminals + terminals)
-            // try goto
-            for(int c = 0; c < MAXCOL; c++){
-                if(c==0) continue;
-                char X = (char)c;
-                // consider only symbols that appear in grammar
-                // compute goto(states[i], X)
-                ItemSet J = goto_set(&states[i], X);
-                if(J.nitems==0) continue;
-                int idx = find_state(&J);
-                if(idx == -1){
-                    // new state
-                    states[nstates] = J;
-                    idx = nstates;
-                    nstates++;
-                    changed = 1;
-                }
-                // record mapping in goto_table later
-            }
+    Expander E;
+    expander_init(&E);
+    int nw = thread_count();
+    if(nw > 1) pool_start(nw);
+    for(int lo=0;lo<nstates;){
+        int hi = nstates;
+        if(nw > 1 && hi - lo >= FRONTIER_MIN) expand_frontier(lo);
+        else for(int i=lo;i<hi;i++) expand_state(&E, i, NULL);
+        lo = hi;
+    }
+    if(nw > 1) pool_stop();
+    expander_free(&E);
+    PHASE_END(STATES);
+}
+
+// DeRemer-Pennello digraph: given a relation R over n nodes (CSR form:
+// successors of x are to[start[x]..start[x+1])) and initial sets F'(x),
+// computes F(x) = F'(x) U { F(y) | x R y } in place. Each strongly
+// connected component is detected once (Tarjan) and its members all take
+// the component's union, so every set is final after a single pass.
+typedef struct {
+    int n, words;
+    const int *start, *to;
+    uint64_t *F;    // n rows of `words` words
+    int *N, *stack, sp;
+} Digraph;
+
+void digraph_traverse(Digraph *g, int x){
+    g->stack[g->sp++] = x;
+    int d = g->sp;
+    g->N[x] = d;
+    STAT(SET_NODES);
+    uint64_t *Fx = g->F + (size_t)x * g->words;
+    for(int e=g->start[x];e<g->start[x+1];e++){
+        int y = g->to[e];
+        if(g->N[y] == 0) digraph_traverse(g, y);
+        if(g->N[y] < g->N[x]) g->N[x] = g->N[y];
+        or_bits(Fx, g->F + (size_t)y * g->words, g->words);
+        STAT(SET_UNIONS);
+    }
+    if(g->N[x] == d){
+        int top;
+        do {
+            top = g->stack[--g->sp];
+            g->N[top] = 0x7fffffff;
+            if(top != x) memcpy(g->F + (size_t)top * g->words, Fx, g->words * sizeof(uint64_t));
+        } while(top != x);
+    }
+}
+
+void digraph(int n, int words, const int *start, const int *to, uint64_t *F){
+    Digraph g = { n, words, start, to, F, calloc(n, sizeof(int)), malloc(n * sizeof(int)), 0 };
+    for(int x=0;x<n;x++) if(g.N[x] == 0) digraph_traverse(&g, x);
+    free(g.N); free(g.stack);
+}
+
+// relation edges collected as (from,to) pairs, then packed into CSR form
+// for digraph(): successors of x are succ[start[x]..start[x+1])
+typedef struct {
+    int nedges, cap;
+    int *from, *to;
+    int *start, *succ;
+} Relation;
+
+void rel_add(Relation *R, int x, int y){
+    if(R->nedges == R->cap){
+        R->cap = R->cap ? 2*R->cap : 64;
+        R->from = realloc(R->from, R->cap * sizeof(int));
+        R->to = realloc(R->to, R->cap * sizeof(int));
+    }
+    R->from[R->nedges] = x; R->to[R->nedges] = y; R->nedges++;
+}
+
+void rel_pack(Relation *R, int n){
+    R->start = calloc(n+1, sizeof(int));
+    R->succ = malloc((R->nedges+1) * sizeof(int));
+    for(int e=0;e<R->nedges;e++) R->start[R->from[e]+1]++;
+    for(int x=0;x<n;x++) R->start[x+1] += R->start[x];
+    int *fill = malloc((n+1) * sizeof(int));
+    memcpy(fill, R->start, (n+1) * sizeof(int));
+    for(int e=0;e<R->nedges;e++) R->succ[fill[R->from[e]]++] = R->to[e];
+    free(fill);
+}
+
+void rel_free(Relation *R){
+    free(R->from); free(R->to); free(R->start); free(R->succ);
+    memset(R, 0, sizeof(*R));
+}
+
+// nullable nonterminals by worklist: each production counts its RHS
+// nonterminals not yet known nullable; when it hits zero the LHS is
+// nullable. occ lists, per nonterminal, the productions it occurs in (once
+// per occurrence), so each one that becomes nullable visits only those.
+void compute_nullable(){
+    int *pending = malloc((nprods + 1) * sizeof(int));
+    int *occ_start = calloc(nnon + 1, sizeof(int));
+    int *queue = malloc((nnon + 1) * sizeof(int)), qh = 0, qt = 0;
+    free(nullable);
+    nullable = calloc(nnon, 1);
+    for(int p=0;p<nprods;p++){
+        pending[p] = 0;
+        for(int k=0;k<prod_len(p);k++){
+            if(is_nonterm(prods[p].rhs[k])) pending[p]++;
+            else { pending[p] = -1; break; } // a terminal: never nullable
         }
+        if(pending[p] > 0)
+            for(int k=0;k<prod_len(p);k++) occ_start[NT(prods[p].rhs[k]) + 1]++;
     }
-    // Populate goto_table with real mappings
-    for(int i=0;i<nstates;i++){
-        for(int c=0;c<MAXCOL;c++) goto_table[i][c] = -1;
+    for(int A=0;A<nnon;A++) occ_start[A+1] += occ_start[A];
+    int *occ = malloc((occ_start[nnon] + 1) * sizeof(int));
+    int *fill = malloc((nnon + 1) * sizeof(int));
+    memcpy(fill, occ_start, nnon * sizeof(int));
+    for(int p=0;p<nprods;p++){
+        if(pending[p] <= 0) continue;
+        for(int k=0;k<prod_len(p);k++) occ[fill[NT(prods[p].rhs[k])]++] = p;
     }
-    for(int i=0;i<nstates;i++){
-        for(int c=0;c<MAXCOL;c++){
-            char X = (char)c;
-            ItemSet J = goto_set(&states[i], X);
-            if(J.nitems==0) continue;
-            int idx = find_state(&J);
-            if(idx!=-1) goto_table[i][c] = idx;
+    for(int p=0;p<nprods;p++){
+        int A = NT(prods[p].lhs);
+        if(pending[p] == 0 && !nullable[A]){ nullable[A] = 1; queue[qt++] = A; }
+    }
+    while(qh < qt){
+        int B = queue[qh++];
+        for(int i=occ_start[B];i<occ_start[B+1];i++){
+            int p = occ[i], A = NT(prods[p].lhs);
+            if(--pending[p] == 0 && !nullable[A]){ nullable[A] = 1; queue[qt++] = A; }
         }
     }
+    free(pending); free(occ_start); free(occ); free(fill); free(queue);
 }
 
-// compute FIRST sets (simple)
+// compute FIRST sets: F'(A) holds terminals that start some RHS of A after
+// a nullable prefix, and A R B when B appears after such a prefix
 void compute_first(){
-    for(int c=0;c<MAXCOL;c++) for(int t=0;t<MAXCOL;t++) firstset[c][t]=0;
-    for(int i=0;i<nterm;i++){
-        char t = terms[i];
-        firstset[cindex(t)][cindex(t)] = 1;
-    }
-    // For nonterminals, initialize to empty
-    for(int iter=0;iter<100;iter++){
-        int changed = 0;
-        for(int p=0;p<nprods;p++){
-            char A = prods[p].lhs;
-            int idxA = cindex(A);
-            if(prods[p].rhs[0]=='#'){
-                if(!nullable[idxA]){ nullable[idxA]=1; changed=1; }
-            } else {
-                int allnull = 1;
-                for(int k=0;k<strlen(prods[p].rhs);k++){
-                    char Y = prods[p].rhs[k];
-                    if(Y>='A' && Y<='Z'){
-                        // add FIRST(Y)-{epsilon} to FIRST(A)
-                        for(int t=0;t<MAXCOL;t++){
-                            if(firstset[cindex(Y)][t] && !firstset[idxA][t]){
-                                firstset[idxA][t]=1; changed=1;
-                            }
-                        }
-                        if(!nullable[cindex(Y)]){ allnull=0; break; }
-                    } else {
-                        if(!firstset[idxA][(int)Y]){ firstset[idxA][(int)Y]=1; changed=1; }
-                        allnull = 0; break;
-                    }
-                }
-                if(allnull){
-                    if(!nullable[idxA]){ nullable[idxA]=1; changed=1; }
-                }
-            }
+    PHASE_BEGIN();
+    compute_nullable();
+    free(firstset);
+    firstset = calloc((size_t)nnon * twords, sizeof(uint64_t));
+    Relation R = {0};
+    for(int p=0;p<nprods;p++){
+        int A = NT(prods[p].lhs);
+        for(int k=0;k<prod_len(p);k++){
+            int Y = prods[p].rhs[k];
+            if(!is_nonterm(Y)){ set_bit(FIRST(A), Y); break; }
+            rel_add(&R, A, NT(Y));
+            if(!nullable[NT(Y)]) break;
         }
-        if(!changed) break;
     }
+    rel_pack(&R, nnon);
+    digraph(nnon, twords, R.start, R.succ, firstset);
+    rel_free(&R);
+    PHASE_END(FIRST);
 }
 
-// helper: add follow terminal
-int add_follow(char A, char t){
-    int idxA = cindex(A), idxt = cindex(t);
-    if(follow[idxA][idxt]) return 0;
-    follow[idxA][idxt]=1;
-    return 1;
-}
-
-// compute FOLLOW sets (simple)
+// compute FOLLOW sets: for A->alpha B beta, F'(B) gets FIRST(beta), and
+// B R A when beta is nullable (FOLLOW(B) includes FOLLOW(A))
 void compute_follow(){
-    for(int i=0;i<MAXSYMS;i++) for(int j=0;j<MAXCOL;j++) follow[i][j]=0;
+    PHASE_BEGIN();
+    free(follow);
+    follow = calloc((size_t)nnon * twords, sizeof(uint64_t));
     // follow(start) contains $
-    add_follow(start_symbol, '$');
-
-    for(int iter=0;iter<200;iter++){
-        int changed = 0;
-        for(int p=0;p<nprods;p++){
-            char A = prods[p].lhs;
-            int len = prod_len(p);
-            for(int i=0;i<len;i++){
-                char B = prods[p].rhs[i];
-                if(!(B>='A' && B<='Z')) continue;
-                // beta = rhs[i+1..]
-                int allnullable = 1;
-                // add FIRST(beta) - epsilon to FOLLOW(B)
-                for(int j=i+1;j<len;j++){
-                    char Y = prods[p].rhs[j];
-                    if(Y>='A' && Y<='Z'){
-                        // add FIRST(Y)
-                        for(int t=0;t<MAXCOL;t++){
-                            if(firstset[cindex(Y)][t]){
-                                if(!follow[cindex(B)][t]){
-                                    follow[cindex(B)][t]=1; changed=1;
-                                }
-                            }
-                        }
-                        if(!nullable[cindex(Y)]){ allnullable=0; break;}
-                    } else {
-                        // terminal
-                        if(!follow[cindex(B)][cindex(Y)]){ follow[cindex(B)][cindex(Y)]=1; changed=1;}
-                        allnullable=0; break;
-                    }
-                }
-                if(allnullable){
-                    // add FOLLOW(A) to FOLLOW(B)
-                    for(int t=0;t<MAXCOL;t++){
-                        if(follow[cindex(A)][t] && !follow[cindex(B)][t]){
-                            follow[cindex(B)][t]=1; changed=1;
-                        }
-                    }
-                }
+    if(is_nonterm(start_symbol)) set_bit(FOLLOW(NT(start_symbol)), eof_sym);
+    Relation R = {0};
+    for(int p=0;p<nprods;p++){
+        int A = NT(prods[p].lhs);
+        int len = prod_len(p);
+        for(int i=0;i<len;i++){
+            int B = prods[p].rhs[i];
+            if(!is_nonterm(B)) continue;
+            int b = NT(B);
+            int j;
+            for(j=i+1;j<len;j++){
+                int Y = prods[p].rhs[j];
+                if(!is_nonterm(Y)){ set_bit(FOLLOW(b), Y); break; }
+                or_bits(FOLLOW(b), FIRST(NT(Y)), twords);
+                if(!nullable[NT(Y)]) break;
             }
+            if(j == len && b != A) rel_add(&R, b, A);
         }
-        if(!changed) break;
     }
+    rel_pack(&R, nnon);
+    digraph(nnon, twords, R.start, R.succ, follow);
+    rel_free(&R);
+    PHASE_END(FOLLOW);
 }
 
-// Build SLR ACTION/GOTO table
-void build_table(){
-    // init
-    for(int i=0;i<MAXSTATES;i++){
-        for(int j=0;j<MAXCOL;j++){
-            action_type[i][j]=0; action_val[i][j]= -1;
-            // goto_table already populated
+// the user's productions (not S'->S) as a cache key
+void grammar_key(GrammarKey *K){
+    for(int p=0;p<nprods;p++){
+        if(p == augmented_index) continue;
+        gcache_key_sym(K, sym_name[prods[p].lhs], strlen(sym_name[prods[p].lhs]));
+        for(int k=0;k<prod_len(p);k++){
+            const char *name = sym_name[prods[p].rhs[k]];
+            gcache_key_sym(K, name, strlen(name));
         }
+        gcache_key_end(K);
     }
+}
 
-    // for each state i and each item [A->alpha . a beta], if goto(i,a)=j and a is terminal, action[i,a]=shift j
-    for(int i=0;i<nstates;i++){
-        for(int k=0;k<states[i].nitems;k++){
-            Item it = states[i].items[k];
-            int len = prod_len(it.prod);
-            if(it.dot < len){
-                char a = prods[it.prod].rhs[it.dot];
-                if(!(a>='A' && a<='Z')){ // terminal
-                    int j = goto_table[i][cindex(a)];
-                    if(j!=-1){
-                        action_type[i][cindex(a)] = 1; action_val[i][cindex(a)] = j;
-                    }
-                } else {
-                    // nonterminal -> goto will set goto_table for GOTO table (we'll use goto_table directly)
-                }
-            } else {
-                // dot at end: A->alpha.
-                if(it.prod == 0){
-                    // augmented production S'->S.
-                    action_type[i][cindex('$')] = 3; // accept
-                } else {
-                    // for every terminal a in FOLLOW(A), set action[i,a] = reduce by prod it.prod
-                    char A = prods[it.prod].lhs;
-                    for(int t=0;t<nterm;t++){
-                        char a = terms[t];
-                        if(follow[cindex(A)][cindex(a)]){
-                            // reduce
-                            // check conflict rudimentary: prefer shift over reduce if shift exists
-                            if(action_type[i][cindex(a)]==1){
-                                // shift/reduce conflict -> keep shift (simple) ; in SLR ambiguous grammars this may be wrong
-                            } else {
-                                action_type[i][cindex(a)] = 2;
-                                action_val[i][cindex(a)] = it.prod;
-                            }
-                        }
-                    }
-                }
-            }
+// nullable, FIRST and FOLLOW from cached facts; -1 if a symbol is missing.
+// S' is not in the cache: it is nullable and starts like S, and nothing follows it.
+int facts_to_sets(const GrammarFacts *G){
+    int *tmap = malloc((G->nterm + 1) * sizeof(int));
+    int S = NT(start_symbol), aug = NT(prods[augmented_index].lhs);
+    for(int i=0;i<G->nterm;i++) tmap[i] = -1;
+    for(int t=0;t<nterm;t++){
+        int i = gcache_find(G->term, G->nterm, sym_name[t], strlen(sym_name[t]));
+        if(i < 0){ free(tmap); return -1; }
+        tmap[i] = t;
+    }
+    free(nullable); free(firstset); free(follow);
+    nullable = calloc(nnon, 1);
+    firstset = calloc((size_t)nnon * twords, sizeof(uint64_t));
+    follow = calloc((size_t)nnon * twords, sizeof(uint64_t));
+    for(int A=0;A<nnon;A++){
+        if(A == aug) continue;
+        int i = gcache_find(G->non, G->nnon, sym_name[nterm+A], strlen(sym_name[nterm+A]));
+        if(i < 0){ free(tmap); return -1; }
+        nullable[A] = G->nullable[i];
+        for(int u=0;u<G->nterm;u++){
+            if(tmap[u] < 0) continue;
+            if(test_bit(GCACHE_FIRST(G, i), u)) set_bit(FIRST(A), tmap[u]);
+            if(test_bit(GCACHE_FOLLOW(G, i), u)) set_bit(FOLLOW(A), tmap[u]);
         }
     }
+    nullable[aug] = nullable[S];
+    memcpy(FIRST(aug), FIRST(S), twords * sizeof(uint64_t));
+    free(tmap);
+    return 0;
 }
 
-// pretty print production
-void print_prod(int idx){
-    printf("%c->%s", prods[idx].lhs, prods[idx].rhs);
+void sets_to_facts(GrammarFacts *G){
+    int aug = NT(prods[augmented_index].lhs), n = 0;
+    gcache_facts_init(G, nterm, nnon - 1);
+    for(int t=0;t<nterm;t++) G->term[t] = strdup(sym_name[t]);
+    for(int A=0;A<nnon;A++){
+        if(A == aug) continue;
+        G->non[n] = strdup(sym_name[nterm+A]);
+        G->nullable[n] = nullable[A];
+        for(int t=0;t<nterm;t++){
+            if(test_bit(FIRST(A), t)) set_bit(GCACHE_FIRST(G, n), t);
+            if(test_bit(FOLLOW(A), t)) set_bit(GCACHE_FOLLOW(G, n), t);
+        }
+        n++;
+    }
 }
 
-// parse input string and print table of steps
-void parse_input(char *input){
-    // stack contains integers (states) and symbols; we'll implement states stack only and keep separate symbol stack
-    int state_stack[MAXSTR]; int top = 0;
-    char sym_stack[MAXSTR]; int stop = 0;
-    state_stack[top++] = 0;
-    sym_stack[stop++] = '#'; // bottom marker (not used)
-    // append $ to input
-    char inbuf[MAXSTR]; strcpy(inbuf, input);
-    int L = strlen(inbuf);
-    if(inbuf[L-1] != '$'){ strcat(inbuf, "$"); }
-    int ip = 0;
+// nullable, FIRST and FOLLOW, taken from $GRAMMAR_CACHE when this grammar
+// has been analyzed before and stored there otherwise
+void analyze_grammar(){
+    if(!gcache_enabled()){ compute_first(); compute_follow(); return; }
+    GrammarKey K = {0};
+    GrammarFacts G = {0};
+    grammar_key(&K);
+    int hit = gcache_load(&K, &G) == 0;
+    if(hit){
+        hit = facts_to_sets(&G) == 0;
+        gcache_facts_free(&G);
+    }
+    if(!hit){
+        compute_first();
+        compute_follow();
+        sets_to_facts(&G);
+        gcache_store(&K, &G);
+        gcache_facts_free(&G);
+    }
+    gcache_key_free(&K);
+}
 
-    printf("\n%-20s | %-20s | %-30s\n", "Stack", "Remaining Input", "Action");
-    printf("--------------------------------------------------------------------------------------\n");
-    while(1){
-        // build stack display: symbols and states (format: s0 A s1 b s2 ...)
-        char stack_disp[512]; stack_disp[0]=0;
-        for(int i=0;i<top;i++){
-            char tmp[16];
-            sprintf(tmp, "%d ", state_stack[i]);
-            strcat(stack_disp, tmp);
-        }
-        char rem[128]; sprintf(rem, "%s", inbuf+ip);
-        // determine action: look at current state and current input symbol
-        int state = state_stack[top-1];
-        char a = inbuf[ip];
-        int atype = action_type[state][cindex(a)];
-        int aval  = action_val[state][cindex(a)];
-        if(atype==1){ // shift
-            printf("%-20s | %-20s | shift %d (on '%c')\n", stack_disp, rem, aval, a);
-            // push a then state
-            sym_stack[stop++] = a;
-            state_stack[top++] = aval;
-            ip++;
-        } else if(atype==2){ // reduce by production aval
-            int p = aval;
+// LALR(1) lookaheads by DeRemer-Pennello over the LR(0) automaton.
+// Nonterminal transitions (p,A) are the nodes:
+//   DR(p,A)    terminals shifted right after goto(p,A)
+//   reads      (p,A) reads (r,C) if r = goto(p,A), C nullable, goto(r,C) exists
+//   includes   (p,A) includes (p',B) if B->beta A gamma, gamma nullable,
+//              and p' reaches p on beta
+//   lookback   reduction (q, A->w) looks back at (p,A) if p reaches q on w
+// Read = digraph(reads, DR), Follow = digraph(includes, Read), and the
+// lookahead of a reduction is the union of Follow over its lookbacks.
+int lalr_mode = 0;
+int table_stats = 0;
+int *trans_id;      // (state, nonterminal) -> transition or -1, nnon per row
+int ntrans;
+// one lookahead set per complete item, grouped by state
+int *la_start;      // nstates+1
+int *la_prod;
+uint64_t *la_sets;  // twords per complete item
+#define TRANS(p,A) trans_id[(size_t)(p) * nnon + (A)]
+#define LA(k) (la_sets + (size_t)(k) * twords)
+
+// lookahead set slot for reduction by prod in state q
+int la_slot(int q, int prod){
+    for(int k=la_start[q];k<la_start[q+1];k++) if(la_prod[k] == prod) return k;
+    return -1;
+}
+
+void compute_lalr(){
+    PHASE_BEGIN();
+    // number the complete items
+    int nla = 0, la_cap = 64;
+    Item *items = NULL; int icap = 0;
+    free(la_start); free(la_prod);
+    la_start = malloc((nstates+1) * sizeof(int));
+    la_prod = malloc(la_cap * sizeof(int));
+    for(int q=0;q<nstates;q++){
+        la_start[q] = nla;
+        int n = state_items(q, &items, &icap);
+        for(int k=0;k<n;k++){
+            if(items[k].dot != prod_len(items[k].prod)) continue;
+            if(nla == la_cap){ la_cap *= 2; la_prod = realloc(la_prod, la_cap * sizeof(int)); }
+            la_prod[nla++] = items[k].prod;
+        }
+    }
+    la_start[nstates] = nla;
+    free(items);
+    free(la_sets);
+    la_sets = calloc((size_t)(nla ? nla : 1) * twords, sizeof(uint64_t));
+
+    // number the nonterminal transitions
+    ntrans = 0;
+    free(trans_id);
+    trans_id = malloc((size_t)nstates * nnon * sizeof(int));
+    int *tstate = malloc((size_t)nstates * nnon * sizeof(int)), *tsym = malloc((size_t)nstates * nnon * sizeof(int));
+    for(int p=0;p<nstates;p++){
+        for(int A=0;A<nnon;A++){
+            TRANS(p, A) = -1;
+            if(GOTO(p, nterm+A) == -1) continue;
+            tstate[ntrans] = p; tsym[ntrans] = nterm+A;
+            TRANS(p, A) = ntrans++;
+        }
+    }
+    uint64_t *F = calloc((size_t)(ntrans ? ntrans : 1) * twords, sizeof(uint64_t));
+    Relation reads = {0}, includes = {0}, lookback = {0};
+
+    for(int x=0;x<ntrans;x++){
+        int r = GOTO(tstate[x], tsym[x]);
+        uint64_t *Fx = F + (size_t)x * twords;
+        for(int t=0;t<nterm;t++)
+            if(GOTO(r, t) != -1) set_bit(Fx, t);
+        // S'->S. in r: accept on end of input
+        for(int k=0;k<states[r].nkernel;k++)
+            if(KERNEL(r)[k].prod == 0 && KERNEL(r)[k].dot == 1) set_bit(Fx, eof_sym);
+        for(int C=0;C<nnon;C++)
+            if(TRANS(r, C) != -1 && nullable[C]) rel_add(&reads, x, TRANS(r, C));
+    }
+    rel_pack(&reads, ntrans);
+    digraph(ntrans, twords, reads.start, reads.succ, F);
+
+    for(int x=0;x<ntrans;x++){
+        int B = tsym[x];
+        for(int p=0;p<nprods;p++){
+            if(prods[p].lhs != B) continue;
             int len = prod_len(p);
-            printf("%-20s | %-20s | reduce by ", stack_disp, rem);
-            print_prod(p); printf("\n");
-            // pop 2*len (for symbols & states) but since we store only states and syms separate:
-            if(len > 0){
-                stop -= len;
-                top -= len;
+            // nullable_suffix[i]: rhs[i..len) derives epsilon
+            int nullable_suffix[len+1];
+            nullable_suffix[len] = 1;
+            for(int i=len-1;i>=0;i--){
+                int Y = prods[p].rhs[i];
+                nullable_suffix[i] = nullable_suffix[i+1] && is_nonterm(Y) && nullable[NT(Y)];
             }
-            // push lhs symbol
-            char A = prods[p].lhs;
-            sym_stack[stop++] = A;
-            // goto from current top state on A
-            int curstate = state_stack[top-1];
-            int nxt = goto_table[curstate][cindex(A)];
-            if(nxt == -1){
-                printf("Error: no goto for state %d on %c\n", curstate, A);
-                return;
+            int q = tstate[x];
+            for(int i=0;i<len && q!=-1;i++){
+                int Y = prods[p].rhs[i];
+                if(is_nonterm(Y) && nullable_suffix[i+1] && TRANS(q, NT(Y)) != -1)
+                    rel_add(&includes, TRANS(q, NT(Y)), x);
+                q = GOTO(q, Y);
             }
-            state_stack[top++] = nxt;
-        } else if(atype==3){
-            printf("%-20s | %-20s | accept\n", stack_disp, rem);
-            return;
-        } else {
-            printf("%-20s | %-20s | error -- no action\n", stack_disp, rem);
-            return;
+            if(q == -1) continue;
+            int slot = la_slot(q, p);
+            if(slot != -1) rel_add(&lookback, slot, x);
         }
     }
+    rel_pack(&includes, ntrans);
+    digraph(ntrans, twords, includes.start, includes.succ, F);
+
+    for(int e=0;e<lookback.nedges;e++)
+        or_bits(LA(lookback.from[e]), F + (size_t)lookback.to[e] * twords, twords);
+
+    rel_free(&reads); rel_free(&includes); rel_free(&lookback);
+    free(F); free(tstate); free(tsym);
+    PHASE_END(LALR);
 }
 
-int main(){
-    printf("SLR Parser (C) - Enter grammar productions.\n");
-    printf("Conventions: use single-char nonterminals A-Z; terminals are other chars; epsilon=#\n");
-    int pcount;
-    printf("Enter number of productions: ");
-    if(scanf("%d%*c", &pcount)!=1) return 0;
-    char line[MAXSTR];
-    for(int i=0;i<pcount;i++){
-        printf("Prod %d: ", i+1);
-        if(!fgets(line, sizeof(line), stdin)){ line[0]=0; }
-        if(strlen(line)==0){ i--; continue; }
-        // trim newline
-        line[strcspn(line, "\n")] = 0;
-        add_production_line(line);
+int sr_conflicts, rr_conflicts;
+// every action of each conflicted ACTION entry, encoded as in the
+// compressed tables; entries of state s are conf_*[conf_start[s]..conf_start[s+1])
+int *conf_start, *conf_term, *conf_act;
+int nconf, conf_cap;
+int glr_mode = 0;
+int tree_mode = 0;
+
+void add_conf(int a, int v){
+    if(nconf == conf_cap){
+        conf_cap = conf_cap ? 2*conf_cap : 64;
+        conf_term = realloc(conf_term, conf_cap * sizeof(int));
+        conf_act = realloc(conf_act, conf_cap * sizeof(int));
     }
-    // Augment grammar: S' -> S (make new production at index 0 by shifting existing)
-    // We'll insert new prod at beginning
-    for(int i=nprods;i>0;i--) prods[i]=prods[i-1];
-    nprods++;
-    prods[0].lhs = 'Z'; // use 'Z' as augmented start (unlikely user used it); but better make S' as ASCII not uppercase - keep 'Z' only if unused
-    // choose a char not used as nonterminal
-    char aug = 'Z';
-    // ensure unique
-    int used[256]={0};
-    for(int i=1;i<nprods;i++) used[(int)prods[i].lhs]=1;
-    for(char ch='A';ch<='Z';ch++) if(!used[(int)ch]){ aug=ch; break; }
-    prods[0].lhs = aug;
-    prods[0].rhs[0] = start_symbol; prods[0].rhs[1]=0;
-    augmented_index = 0;
-    start_symbol = start_symbol; // unchanged
+    conf_term[nconf] = a; conf_act[nconf] = v; nconf++;
+}
+
+// ACTION row of state i (cleared beforehand) from its n items, counting
+// conflicts and listing the actions of conflicted entries; nact is scratch
+// for nterm counts
+void build_row(int i, const Item *items, int n, int *nact){
+    memset(nact, 0, nterm * sizeof(int));
+    // for each item [A->alpha . a beta], if goto(i,a)=j and a is terminal, action[i,a]=shift j
+    for(int k=0;k<n;k++){
+        Item it = items[k];
+        int len = prod_len(it.prod);
+        if(it.dot < len){
+            int a = prods[it.prod].rhs[it.dot];
+            if(!is_nonterm(a)){ // terminal
+                int j = GOTO(i, a);
+                if(j!=-1){
+                    ACT_TYPE(i, a) = 1; ACT_VAL(i, a) = j;
+                    nact[a] = 1;
+                }
+            }
+        } else if(it.prod == 0){
+            // augmented production S'->S.
+            ACT_TYPE(i, eof_sym) = 3; // accept
+            nact[eof_sym] = 1;
+        }
+    }
+    // dot at end: A->alpha. reduces on every terminal of its lookahead set,
+    // FOLLOW(A) for SLR or the exact LALR(1) set
+    for(int k=0;k<n;k++){
+        Item it = items[k];
+        if(it.dot < prod_len(it.prod) || it.prod == 0) continue;
+        const uint64_t *la = lalr_mode ? LA(la_slot(i, it.prod)) : FOLLOW(NT(prods[it.prod].lhs));
+        for(int a=0;a<nterm;a++){
+            if(!test_bit(la, a)) continue;
+            nact[a]++;
+            if(ACT_TYPE(i, a)==1 || ACT_TYPE(i, a)==3){
+                sr_conflicts++;
+            } else if(ACT_TYPE(i, a)==2){
+                rr_conflicts++;
+                if(it.prod < ACT_VAL(i, a)) ACT_VAL(i, a) = it.prod;
+            } else {
+                ACT_TYPE(i, a) = 2;
+                ACT_VAL(i, a) = it.prod;
+            }
+        }
+    }
+    // conflicted entries: the shift or accept (which won), then every reduction
+    for(int a=0;a<nterm;a++){
+        if(nact[a] < 2) continue;
+        if(ACT_TYPE(i, a)==1) add_conf(a, ACT_VAL(i, a) + 1);
+        else if(ACT_TYPE(i, a)==3) add_conf(a, -1);
+        for(int k=0;k<n;k++){
+            Item it = items[k];
+            if(it.dot < prod_len(it.prod) || it.prod == 0) continue;
+            const uint64_t *la = lalr_mode ? LA(la_slot(i, it.prod)) : FOLLOW(NT(prods[it.prod].lhs));
+            if(test_bit(la, a)) add_conf(a, -(it.prod + 1));
+        }
+    }
+}
+
+// Build SLR (or LALR(1)) ACTION/GOTO table. Conflicts are counted and
+// resolved the yacc way: shift beats reduce, the earlier production wins
+// a reduce/reduce. All actions of a conflicted entry are also kept in the
+// conf_* lists for the GLR parser.
+void build_table(){
+    PHASE_BEGIN();
+    // init
+    free(action_type); free(action_val);
+    action_type = calloc((size_t)nstates * nterm, sizeof(int));
+    action_val = malloc((size_t)nstates * nterm * sizeof(int));
+    for(size_t i=0;i<(size_t)nstates * nterm;i++) action_val[i] = -1;
+    // goto_table already populated
+    if(lalr_mode) compute_lalr();
+    sr_conflicts = rr_conflicts = 0;
+    free(conf_start);
+    conf_start = malloc((nstates + 1) * sizeof(int));
+    nconf = 0;
+    int *nact = malloc(nterm * sizeof(int));   // actions per terminal in this state
+
+    Item *items = NULL; int icap = 0;
+    for(int i=0;i<nstates;i++){
+        int n = state_items(i, &items, &icap);
+        conf_start[i] = nconf;
+        build_row(i, items, n, nact);
+    }
+    conf_start[nstates] = nconf;
+    free(items); free(nact);
+    PHASE_END(TABLE);
+}
+
+// Incremental grammar edits. grammar_add() and grammar_remove() change the
+// productions and bring nullable, FIRST, FOLLOW, the LR(0) states and the
+// dense ACTION/GOTO rows up to date, redoing only what an edit can reach:
+//   - nullable and FIRST of the nonterminals with a production mentioning
+//     the edited lhs, directly or through another such nonterminal
+//   - FOLLOW of the nonterminals in the edited rhs and of those sharing a
+//     rhs with a symbol whose FIRST or nullable changed, plus everything
+//     their FOLLOW flows into
+//   - states with a kernel item whose dot is before a nonterminal pulling
+//     the edited production into the closure are expanded again; new
+//     targets become new states, states with the removed production in
+//     their kernel die, and whatever is no longer reachable from state 0
+//     is dropped (survivors keep their relative order)
+//   - ACTION rows of re-expanded and new states and of states reducing a
+//     nonterminal whose FOLLOW changed (all rows in LALR mode, since the
+//     lookaheads are global); other rows only have state and production
+//     numbers renumbered
+// An edit that adds or drops a symbol, or gives a nonterminal its first or
+// takes away its last production, renumbers the symbols and falls back to
+// a full rebuild. The compressed tables are left to the caller.
+typedef struct {
+    int full;                       // rebuilt from scratch
+    int first_redone, first_changed;    // nonterminals
+    int follow_redone, follow_changed;
+    int states_dirty, states_added, states_removed;
+    int rows_rebuilt;
+    double ms;
+} GrammarDelta;
 
+// everything derived from the productions, from scratch
+void rebuild_grammar(){
+    for(int p=0;p<nprods;p++){ free(prods[p].rhs); prods[p].rhs = NULL; }
+    for(int X=0;X<nsyms;X++) free(sym_name[X]);
+    free(sym_name); free(sym_rank);
     collect_symbols();
     compute_first();
     compute_follow();
     build_states();
     build_table();
+}
 
-    // print productions
-    printf("\nProductions (numbered):\n");
-    for(int i=0;i<nprods;i++){
-        printf("%2d: ", i); print_prod(i); printf("\n");
+// id of the symbol named s[0..n), or -1
+int symbol_id(const char *s, int n){
+    for(int X=0;X<nsyms;X++)
+        if((int)strlen(sym_name[X]) == n && memcmp(sym_name[X], s, n) == 0) return X;
+    return -1;
+}
+
+// split alt into the current symbols as collect_symbols() would; returns
+// the rhs length, or -1 if it names a symbol the grammar does not have
+int split_known(const char *alt, int *rhs){
+    char *has = calloc(nnon, 1);
+    int chars = 0, n = strlen(alt) + 1, count = 0;
+    for(int p=0;p<nprods;p++) has[NT(prods[p].lhs)] = 1;
+    for(int A=0;A<nnon;A++) if(has[A]) chars += strlen(sym_name[nterm+A]);
+    NameTrie T;
+    trie_init(&T, chars);
+    for(int A=0;A<nnon;A++) if(has[A]) trie_add(&T, sym_name[nterm+A]);
+    int *off = malloc(n * sizeof(int)), *len = malloc(n * sizeof(int));
+    char *nt = malloc(n);
+    if(!is_epsilon(alt, &T)){
+        count = split_alt(alt, &T, off, len, nt);
+        for(int k=0;k<count && count!=-1;k++){
+            rhs[k] = symbol_id(alt + off[k], len[k]);
+            if(rhs[k] == -1 || is_nonterm(rhs[k]) != nt[k]) count = -1;
+        }
     }
-    printf("\nNumber of states: %d\n", nstates);
+    trie_free(&T); free(has); free(off); free(len); free(nt);
+    return count;
+}
 
-    // optional: print ACTION table summary (terminals only)
-    printf("\nACTION (state x terminal) summary (non-empty entries):\n");
-    for(int i=0;i<nstates;i++){
-        for(int t=0;t<nterm;t++){
-            char a = terms[t];
-            int typ = action_type[i][cindex(a)];
-            if(typ==1) printf("state %d, '%c' : shift %d\n", i, a, action_val[i][cindex(a)]);
-            else if(typ==2) printf("state %d, '%c' : reduce by %d\n", i, a, action_val[i][cindex(a)]);
-            else if(typ==3) printf("state %d, '%c' : accept\n", i, a);
+// conflict totals from the conf_* lists: an entry with a shift or accept
+// and k reductions is k shift/reduce conflicts, one without is k-1
+// reduce/reduce conflicts, as build_row() counts them
+void count_conflicts(){
+    sr_conflicts = rr_conflicts = 0;
+    for(int s=0;s<nstates;s++)
+        for(int k=conf_start[s];k<conf_start[s+1];){
+            int j = k + 1;
+            while(j < conf_start[s+1] && conf_term[j] == conf_term[k]) j++;
+            if(conf_act[k] > 0 || conf_act[k] == -1) sr_conflicts += j - k - 1;
+            else rr_conflicts += j - k - 1;
+            k = j;
+        }
+}
+
+// apply one edit: production p has just been appended (adding) or is about
+// to be dropped (!adding); p > 0 and the symbols are unchanged
+void grammar_update(int p, int adding, GrammarDelta *d){
+    int L = NT(prods[p].lhs), len = prod_len(p);
+    int *erhs = malloc((len + 1) * sizeof(int));
+    memcpy(erhs, prods[p].rhs, len * sizeof(int));
+    int old_n = nstates;
+
+    // nonterminals whose FIRST and nullable may depend on L: those that
+    // mention it, transitively (uses[Y] lists the productions using Y)
+    Relation uses = {0}, by_lhs = {0};
+    for(int q=0;q<nprods;q++){
+        rel_add(&by_lhs, NT(prods[q].lhs), q);
+        for(int k=0;k<prod_len(q);k++)
+            if(is_nonterm(prods[q].rhs[k])) rel_add(&uses, NT(prods[q].rhs[k]), q);
+    }
+    rel_pack(&uses, nnon); rel_pack(&by_lhs, nnon);
+    char *fdep = calloc(nnon, 1);
+    int *queue = malloc(nnon * sizeof(int)), qt = 0;
+    fdep[L] = 1; queue[qt++] = L;
+    for(int qh=0;qh<qt;qh++)
+        for(int e=uses.start[queue[qh]];e<uses.start[queue[qh]+1];e++){
+            int B = NT(prods[uses.succ[e]].lhs);
+            if(!fdep[B]){ fdep[B] = 1; queue[qt++] = B; }
+        }
+    d->first_redone += qt;
+
+    // closure rows holding L's productions gain p, plus C's row if p
+    // starts with nonterminal C, or lose p. The states with a kernel item
+    // before such a row's nonterminal are dirty, and only their gotos on
+    // xset, the first symbols of productions entering or leaving a closure,
+    // can change (all of them when the rows are recomputed from scratch)
+    char *cdirty = calloc(nnon, 1), *xset = calloc(nsyms, 1);
+    int C = len && is_nonterm(erhs[0]) ? NT(erhs[0]) : -1, recompute = 0;
+    if(adding){
+        int a0;
+        for(a0=0;NT(prods[a0].lhs) != L;a0++) ;
+        if((nprods + 63) / 64 != pwords){
+            compute_closure_sets();
+            recompute = 1;
+        } else {
+            uint64_t extra[pwords], gained[pwords];
+            memset(gained, 0, sizeof(gained));
+            if(C != -1) memcpy(extra, CLOSURE(C), sizeof(extra));
+            else memset(extra, 0, sizeof(extra));
+            for(int B=0;B<nnon;B++){
+                if(!test_bit(CLOSURE(B), a0)) continue;
+                for(int w=0;w<pwords;w++){ gained[w] |= extra[w] & ~CLOSURE(B)[w]; CLOSURE(B)[w] |= extra[w]; }
+                set_bit(CLOSURE(B), p);
+            }
+            for(int w=0;w<pwords;w++)
+                for(uint64_t m = gained[w]; m; m &= m-1){
+                    int q = w*64 + __builtin_ctzll(m);
+                    if(prod_len(q)) xset[prods[q].rhs[0]] = 1;
+                }
+        }
+    } else if(C != -1){
+        // the left-corner edge L -> C goes if no other production of L starts with C
+        recompute = 1;
+        for(int e=by_lhs.start[L];e<by_lhs.start[L+1];e++){
+            int q = by_lhs.succ[e];
+            if(q != p && prod_len(q) && prods[q].rhs[0] == erhs[0]) recompute = 0;
+        }
+    }
+    if(len) xset[erhs[0]] = 1;
+    for(int B=0;B<nnon;B++) cdirty[B] = test_bit(CLOSURE(B), p);
+
+    char *dead = calloc(nstates, 1);
+    if(!adding){
+        // drop p: later productions move down one, in the kernels too
+        free(prods[p].name); free(prods[p].alt); free(prods[p].rhs);
+        memmove(prods + p, prods + p + 1, (nprods - p - 1) * sizeof(Production));
+        nprods--;
+        for(int s=0;s<nstates;s++){
+            Item *k = KERNEL(s);
+            for(int i=0;i<states[s].nkernel;i++){
+                if(k[i].prod == p) dead[s] = 1;
+                else if(k[i].prod > p) k[i].prod--;
+            }
+            unsigned h = 2166136261u;
+            for(int i=0;i<states[s].nkernel;i++){
+                h = (h ^ (unsigned)k[i].prod) * 16777619u;
+                h = (h ^ (unsigned)k[i].dot) * 16777619u;
+            }
+            states[s].hash = h;
+            // an empty kernel matches no goto, even once add_state() rehashes
+            if(dead[s]) states[s].nkernel = 0;
+        }
+        for(int i=0;i<index_cap;i++) state_index[i] = -1;
+        for(int s=0;s<nstates;s++) if(!dead[s]) index_state(s);
+        if(recompute || (nprods + 63) / 64 != pwords){
+            compute_closure_sets();
+            recompute = 1;
+        } else for(int B=0;B<nnon;B++) delete_bit(CLOSURE(B), pwords, p);
+    }
+
+    // nullable and FIRST of fdep, the others taken as they are
+    char *old_null = malloc(nnon);
+    memcpy(old_null, nullable, nnon);
+    uint64_t *old_first = malloc((size_t)nnon * twords * sizeof(uint64_t));
+    memcpy(old_first, firstset, (size_t)nnon * twords * sizeof(uint64_t));
+    for(int i=0;i<qt;i++){
+        nullable[queue[i]] = 0;
+        memset(FIRST(queue[i]), 0, twords * sizeof(uint64_t));
+    }
+    for(int changed=1;changed;){
+        changed = 0;
+        for(int i=0;i<qt;i++){
+            int A = queue[i];
+            if(nullable[A]) continue;
+            for(int e=by_lhs.start[A];e<by_lhs.start[A+1] && !nullable[A];e++){
+                int q = by_lhs.succ[e];
+                if(!adding && q == p) continue;     // uses and by_lhs predate the removal
+                if(!adding && q > p) q--;
+                int k;
+                for(k=0;k<prod_len(q);k++){
+                    int Y = prods[q].rhs[k];
+                    if(!is_nonterm(Y) || !nullable[NT(Y)]) break;
+                }
+                if(k == prod_len(q)){ nullable[A] = 1; changed = 1; }
+            }
+        }
+    }
+    Relation R = {0};
+    for(int q=0;q<nprods;q++){
+        int A = NT(prods[q].lhs);
+        if(!fdep[A]) continue;
+        for(int k=0;k<prod_len(q);k++){
+            int Y = prods[q].rhs[k];
+            if(!is_nonterm(Y)){ set_bit(FIRST(A), Y); break; }
+            if(fdep[NT(Y)]) rel_add(&R, A, NT(Y));
+            else or_bits(FIRST(A), FIRST(NT(Y)), twords);
+            if(!nullable[NT(Y)]) break;
+        }
+    }
+    rel_pack(&R, nnon);
+    digraph(nnon, twords, R.start, R.succ, firstset);
+    rel_free(&R);
+
+    // FOLLOW: seeds are the edited rhs and the rhs of every production
+    // using a symbol whose FIRST or nullable changed; FOLLOW(A) flows into
+    // the symbols of A's productions
+    char *aff = calloc(nnon, 1);
+    int *fq = malloc(nnon * sizeof(int)), ft = 0;
+    for(int k=0;k<len;k++)
+        if(is_nonterm(erhs[k]) && !aff[NT(erhs[k])]){ aff[NT(erhs[k])] = 1; fq[ft++] = NT(erhs[k]); }
+    for(int i=0;i<qt;i++){
+        int A = queue[i];
+        if(nullable[A] == old_null[A] && memcmp(FIRST(A), old_first + (size_t)A * twords, twords * sizeof(uint64_t)) == 0) continue;
+        d->first_changed++;
+        for(int e=uses.start[A];e<uses.start[A+1];e++){
+            int q = uses.succ[e];
+            if(!adding && q == p) continue;
+            if(!adding && q > p) q--;
+            for(int k=0;k<prod_len(q);k++){
+                int Y = prods[q].rhs[k];
+                if(is_nonterm(Y) && !aff[NT(Y)]){ aff[NT(Y)] = 1; fq[ft++] = NT(Y); }
+            }
+        }
+    }
+    for(int qh=0;qh<ft;qh++)
+        for(int e=by_lhs.start[fq[qh]];e<by_lhs.start[fq[qh]+1];e++){
+            int q = by_lhs.succ[e];
+            if(!adding && q == p) continue;
+            if(!adding && q > p) q--;
+            for(int k=0;k<prod_len(q);k++){
+                int Y = prods[q].rhs[k];
+                if(is_nonterm(Y) && !aff[NT(Y)]){ aff[NT(Y)] = 1; fq[ft++] = NT(Y); }
+            }
+        }
+    d->follow_redone += ft;
+    uint64_t *old_follow = malloc((size_t)ft * twords * sizeof(uint64_t) + 1);
+    for(int i=0;i<ft;i++){
+        memcpy(old_follow + (size_t)i * twords, FOLLOW(fq[i]), twords * sizeof(uint64_t));
+        memset(FOLLOW(fq[i]), 0, twords * sizeof(uint64_t));
+    }
+    if(is_nonterm(start_symbol) && aff[NT(start_symbol)]) set_bit(FOLLOW(NT(start_symbol)), eof_sym);
+    for(int q=0;q<nprods;q++){
+        int A = NT(prods[q].lhs), n = prod_len(q);
+        for(int i=0;i<n;i++){
+            int B = prods[q].rhs[i];
+            if(!is_nonterm(B) || !aff[NT(B)]) continue;
+            int b = NT(B), j;
+            for(j=i+1;j<n;j++){
+                int Y = prods[q].rhs[j];
+                if(!is_nonterm(Y)){ set_bit(FOLLOW(b), Y); break; }
+                or_bits(FOLLOW(b), FIRST(NT(Y)), twords);
+                if(!nullable[NT(Y)]) break;
+            }
+            if(j < n || b == A) continue;
+            if(aff[A]) rel_add(&R, b, A);
+            else or_bits(FOLLOW(b), FOLLOW(A), twords);
+        }
+    }
+    rel_pack(&R, nnon);
+    digraph(nnon, twords, R.start, R.succ, follow);
+    rel_free(&R);
+    char *fchanged = calloc(nnon, 1);
+    for(int i=0;i<ft;i++)
+        if(memcmp(FOLLOW(fq[i]), old_follow + (size_t)i * twords, twords * sizeof(uint64_t)) != 0){
+            fchanged[fq[i]] = 1; d->follow_changed++;
+        }
+
+    // expand the states whose closure changed again, then the new ones
+    char *dirty = calloc(nstates, 1);
+    for(int s=0;s<nstates;s++){
+        if(dead[s]) continue;
+        const Item *k = KERNEL(s);
+        for(int i=0;i<states[s].nkernel && !dirty[s];i++){
+            if(k[i].dot == prod_len(k[i].prod)) continue;
+            int B = prods[k[i].prod].rhs[k[i].dot];
+            if(is_nonterm(B) && cdirty[NT(B)]) dirty[s] = 1;
+        }
+        d->states_dirty += dirty[s];
+    }
+    Expander E;
+    expander_init(&E);
+    for(int s=0;s<old_n;s++){
+        if(!dirty[s]) continue;
+        for(int X=0;X<nsyms;X++) if(recompute || xset[X]) GOTO(s, X) = -1;
+        expand_state(&E, s, recompute ? NULL : xset);
+    }
+    for(int s=old_n;s<nstates;s++) expand_state(&E, s, NULL);
+    expander_free(&E);
+
+    // keep what state 0 still reaches, in the old order
+    int *newof = malloc(nstates * sizeof(int)), *bfs = malloc(nstates * sizeof(int)), bt = 0;
+    for(int s=0;s<nstates;s++) newof[s] = -1;
+    newof[0] = 0; bfs[bt++] = 0;
+    for(int bh=0;bh<bt;bh++){
+        const int *row = &GOTO(bfs[bh], 0);
+        for(int X=0;X<nsyms;X++){
+            int t = row[X];
+            if(t != -1 && newof[t] == -1){ newof[t] = 0; bfs[bt++] = t; }
+        }
+    }
+    int all_n = nstates, n = 0, alen = 0;
+    int *oldof = malloc(nstates * sizeof(int));
+    for(int s=0;s<all_n;s++){
+        if(newof[s] == -1){ if(s < old_n) d->states_removed++; continue; }
+        if(s >= old_n) d->states_added++;
+        newof[s] = n; oldof[n] = s;
+        memmove(item_arena + alen, KERNEL(s), states[s].nkernel * sizeof(Item));
+        states[n] = states[s]; states[n].kbase = alen;
+        alen += states[s].nkernel;
+        n++;
+    }
+    // rows move down in place: no state gets a higher number
+    for(int t=0;t<n;t++){
+        const int *from = &GOTO(oldof[t], 0);
+        int *to = &GOTO(t, 0);
+        for(int X=0;X<nsyms;X++) to[X] = from[X] == -1 ? -1 : newof[from[X]];
+    }
+    nstates = n; arena_len = alen;
+    for(int i=0;i<index_cap;i++) state_index[i] = -1;
+    for(int s=0;s<nstates;s++) index_state(s);
+
+    // ACTION rows: rebuild those whose items or lookaheads changed, renumber the rest
+    if(lalr_mode){
+        build_table();
+        d->rows_rebuilt += nstates;
+    } else {
+        int *ostart = conf_start, *oterm = conf_term, *oact = conf_act;
+        // epsilon productions whose lhs FOLLOW changed: a closure holding
+        // one of them reduces on the new FOLLOW
+        uint64_t eps[pwords];
+        memset(eps, 0, sizeof(eps));
+        for(int q=1;q<nprods;q++)
+            if(prod_len(q) == 0 && fchanged[NT(prods[q].lhs)]) set_bit(eps, q);
+        // rows move down in place as in GOTO; new states' rows may lie
+        // past the old table
+        if(nstates > old_n){
+            action_type = realloc(action_type, (size_t)nstates * nterm * sizeof(int));
+            action_val = realloc(action_val, (size_t)nstates * nterm * sizeof(int));
+        }
+        conf_start = malloc((nstates + 1) * sizeof(int));
+        conf_term = conf_act = NULL; nconf = conf_cap = 0;
+        int *nact = malloc(nterm * sizeof(int));
+        Item *items = NULL; int icap = 0;
+        for(int t=0;t<nstates;t++){
+            int s = oldof[t], redo = s >= old_n || dirty[s];
+            const Item *k = KERNEL(t);
+            for(int i=0;i<states[t].nkernel && !redo;i++){
+                if(k[i].dot == prod_len(k[i].prod)){
+                    if(k[i].prod != 0 && fchanged[NT(prods[k[i].prod].lhs)]) redo = 1;
+                    continue;
+                }
+                int B = prods[k[i].prod].rhs[k[i].dot];
+                if(!is_nonterm(B)) continue;
+                for(int w=0;w<pwords;w++) if(CLOSURE(NT(B))[w] & eps[w]) redo = 1;
+            }
+            conf_start[t] = nconf;
+            int *ty = &ACT_TYPE(t, 0), *va = &ACT_VAL(t, 0);
+            if(redo){
+                memset(ty, 0, nterm * sizeof(int));
+                for(int a=0;a<nterm;a++) va[a] = -1;
+                build_row(t, items, state_items(t, &items, &icap), nact);
+                d->rows_rebuilt++;
+                continue;
+            }
+            // renumber: shift targets by newof, reductions past p down one
+            const int *oty = &ACT_TYPE(s, 0), *ova = &ACT_VAL(s, 0);
+            for(int a=0;a<nterm;a++){
+                int v = ova[a];
+                if(oty[a] == 1) v = newof[v];
+                else if(oty[a] == 2 && !adding && v > p) v--;
+                ty[a] = oty[a]; va[a] = v;
+            }
+            for(int c=ostart[s];c<ostart[s+1];c++){
+                int v = oact[c];
+                if(v > 0) v = newof[v-1] + 1;
+                else if(v < -1 && !adding && -v-1 > p) v++;
+                add_conf(oterm[c], v);
+            }
+        }
+        conf_start[nstates] = nconf;
+        count_conflicts();
+        free(items); free(nact);
+        free(ostart); free(oterm); free(oact);
+    }
+
+    free(erhs); rel_free(&uses); rel_free(&by_lhs);
+    free(fdep); free(queue); free(cdirty); free(xset); free(dead); free(old_null); free(old_first);
+    free(aff); free(fq); free(old_follow); free(fchanged); free(dirty);
+    free(newof); free(bfs); free(oldof);
+}
+
+// add the productions of line ("A->alpha|beta") one by one; see
+// grammar_update(). Returns -1 if line is not a production.
+int grammar_add(char *line, GrammarDelta *d){
+    double t0 = now_sec();
+    memset(d, 0, sizeof(*d));
+    int first = nprods;
+    add_production_line(line);
+    if(nprods == first){ fprintf(stderr, "not a production: %s\n", line); return -1; }
+    int total = nprods, full = 0;
+    int L = symbol_id(prods[first].name, strlen(prods[first].name));
+    if(L == -1 || !is_nonterm(L)) full = 1;
+    else {
+        int q;
+        for(q=1;q<first && prods[q].lhs != L;q++) ;
+        if(q == first) full = 1;
+    }
+    for(int q=first;q<total;q++){
+        prods[q].rhs = malloc((strlen(prods[q].alt) + 1) * sizeof(int));
+        if(full) continue;
+        prods[q].lhs = L;
+        nprods = first;     // split as the grammar before the edit would
+        prods[q].len = split_known(prods[q].alt, prods[q].rhs);
+        nprods = total;
+        if(prods[q].len < 0) full = 1;
+    }
+    if(full){
+        rebuild_grammar();
+        d->full = 1;
+    } else {
+        for(int q=first;q<total;q++){
+            nprods = q + 1;
+            grammar_update(q, 1, d);
+        }
+    }
+    d->ms = (now_sec()-t0) * 1e3;
+    return 0;
+}
+
+// drop production p (numbered as listed, 0 being the augmented one).
+// Returns -1 if there is no such production.
+int grammar_remove(int p, GrammarDelta *d){
+    double t0 = now_sec();
+    memset(d, 0, sizeof(*d));
+    if(p <= 0 || p >= nprods){ fprintf(stderr, "no production %d\n", p); return -1; }
+    // every symbol must survive: the lhs keeps a production, each rhs
+    // symbol is a lhs or used elsewhere
+    char *kept = calloc(nsyms, 1);
+    for(int q=0;q<nprods;q++){
+        if(q == p) continue;
+        kept[prods[q].lhs] = 1;
+        for(int k=0;k<prod_len(q);k++) kept[prods[q].rhs[k]] = 1;
+    }
+    int full = !kept[prods[p].lhs];
+    for(int k=0;k<prod_len(p);k++) if(!kept[prods[p].rhs[k]] && prods[p].rhs[k] != eof_sym) full = 1;
+    free(kept);
+    if(full){
+        free(prods[p].name); free(prods[p].alt); free(prods[p].rhs);
+        memmove(prods + p, prods + p + 1, (nprods - p - 1) * sizeof(Production));
+        nprods--;
+        rebuild_grammar();
+        d->full = 1;
+    } else grammar_update(p, 0, d);
+    d->ms = (now_sec()-t0) * 1e3;
+    return 0;
+}
+
+// production numbered like "A->alpha" (same lhs, same symbols), or -1
+int find_production(const char *line){
+    const char *arrow = strstr(line, "->");
+    if(!arrow) return -1;
+    char *name = trim_copy(line, arrow - line), *alt = trim_copy(arrow + 2, strlen(arrow + 2));
+    if(!*alt){ free(alt); alt = strdup("#"); }
+    int *rhs = malloc((strlen(alt) + 1) * sizeof(int));
+    int n = split_known(alt, rhs), found = -1;
+    for(int q=1;q<nprods && found==-1 && n>=0;q++)
+        if(strcmp(prods[q].name, name) == 0 && prod_len(q) == n && memcmp(prods[q].rhs, rhs, n * sizeof(int)) == 0) found = q;
+    free(name); free(alt); free(rhs);
+    return found;
+}
+
+// Unit-reduction elimination (--unit-elim). A state whose only actions
+// are reductions by one unit production A->B just pops the B it was
+// entered on and goes to goto(p,A). Where goto(p,B) is such a state and
+// goto(p,A) acts on no terminal the unit state rejects, goto(p,B) is
+// pointed at goto(p,A) directly, following chains like F -> T -> E. The
+// same inputs are accepted and errors are found at the same token; the
+// bypassed states are left in the tables, unreachable.
+int unit_elim = 0;
+
+// production u if state q does nothing but reduce by unit production u
+int unit_state(int q){
+    int u = -1;
+    if(conf_start[q] != conf_start[q+1]) return -1;
+    for(int X=0;X<nsyms;X++) if(GOTO(q, X) != -1) return -1;
+    for(int a=0;a<nterm;a++){
+        if(ACT_TYPE(q, a) == 0) continue;
+        if(ACT_TYPE(q, a) != 2) return -1;
+        int p = ACT_VAL(q, a);
+        if(p == 0 || prod_len(p) != 1 || !is_nonterm(prods[p].rhs[0])) return -1;
+        if(u != -1 && u != p) return -1;
+        u = p;
+    }
+    return u;
+}
+
+// rewrite GOTO past unit states; returns the number of entries changed
+int eliminate_unit_reductions(){
+    PHASE_BEGIN();
+    int *unit = malloc(nstates * sizeof(int));
+    for(int q=0;q<nstates;q++) unit[q] = unit_state(q);
+    int bypassed = 0;
+    // each pass shortens chains by one step; a cyclic grammar could keep
+    // two unit states pointing at each other, so passes are bounded
+    for(int pass=0, changed=1;changed && pass<=nnon;pass++){
+        changed = 0;
+        for(int p=0;p<nstates;p++){
+            for(int B=nterm;B<nsyms;B++){
+                int q = GOTO(p, B);
+                if(q == -1 || unit[q] == -1) continue;
+                int r = GOTO(p, prods[unit[q]].lhs);
+                if(r == -1 || r == q) continue;
+                int ok = 1;
+                for(int a=0;a<nterm && ok;a++)
+                    if(ACT_TYPE(r, a) != 0 && ACT_TYPE(q, a) == 0) ok = 0;
+                if(!ok) continue;
+                GOTO(p, B) = r;
+                bypassed++; changed = 1;
+            }
+        }
+    }
+    free(unit);
+    PHASE_END(UNIT_ELIM);
+    return bypassed;
+}
+
+// Compressed parse tables. An action is one int: 0 error, s+1 shift to s,
+// -(r+1) reduce by r, with reduce by production 0 meaning accept.
+//   - terminals whose ACTION columns are identical share a class (tclass),
+//     the unknown token (id nterms) maps to class 0, a column that is
+//     always empty
+//   - each state's most common reduction becomes its default action and
+//     is dropped from the row, along with the row's error entries
+//   - the remaining entries of all rows are overlaid in one comb vector:
+//     entry (s,cls) lives at abase[s]+cls if acheck there equals s
+//   - GOTO is stored per nonterminal the same way, around a default target
+//   - the input lexer tries terminals by first byte, longest first:
+//     candidates for byte c are lex_ids[lex_start[c]..lex_start[c+1])
+//   - conflicted entries keep every action for the GLR parser: those of
+//     (s,t) are cact[k] for k in cstart[s]..cstart[s+1] with cterm[k] == t;
+//     the comb holds the action the yacc rules chose
+// Tables loaded with load_tables() point into a read-only file mapping.
+typedef struct {
+    int nstates, nclasses, nprods;
+    int nterms, nnonterms, eof;     // symbol counts, id of $
+    int *tclass;                // nterms+1 entries
+    int *defact;                // per state
+    int *abase, *acheck, *aval; // action comb, alen entries
+    int alen;
+    int *gdef, *gbase;          // default goto and comb base per nonterminal
+    int *gcheck, *gval;         // goto comb, glen entries
+    int glen;
+    int *prod_lhs, *prod_len;   // lhs nonterminal index and rhs length per production
+    int *prod_text;             // offset of "A->rhs" in strtab per production
+    int *sym_text;              // offset of each symbol's name in strtab
+    int *term_len;              // name length per terminal
+    int *lex_start, *lex_ids;   // 257 and nterms entries
+    int *cstart;                // nstates+1 entries
+    int *cterm, *cact;          // nconf entries
+    int nconf;
+    char *strtab;
+    int strbytes;
+} ParseTables;
+
+ParseTables ptab;
+
+int tbl_action(const ParseTables *T, int s, int t){
+    STAT(ACTION_LOOKUPS);
+    int i = T->abase[s] + T->tclass[t];
+    return T->acheck[i] == s ? T->aval[i] : T->defact[s];
+}
+
+int tbl_goto(const ParseTables *T, int s, int A){
+    STAT(GOTO_LOOKUPS);
+    int i = T->gbase[A] + s;
+    return T->gcheck[i] == A ? T->gval[i] : T->gdef[A];
+}
+
+// next input token: skips blanks, then takes the longest terminal name at
+// in[*pos]. Returns T->eof at the end of input and T->nterms (the unknown
+// token) for a byte no terminal starts with; *start gets the token offset.
+int lex_token(const ParseTables *T, const char *in, int *pos, int end, int *start){
+    int i = *pos;
+    while(i < end && isspace((unsigned char)in[i])) i++;
+    if(start) *start = i;
+    if(i == end){ *pos = i; return T->eof; }
+    int c = (unsigned char)in[i];
+    for(int k=T->lex_start[c];k<T->lex_start[c+1];k++){
+        int t = T->lex_ids[k], n = T->term_len[t];
+        if(n <= end - i && memcmp(in + i, T->strtab + T->sym_text[t], n) == 0){ *pos = i + n; return t; }
+    }
+    *pos = i + 1;
+    return T->nterms;
+}
+
+int encode_action(int s, int t){
+    switch(ACT_TYPE(s, t)){
+    case 1: return ACT_VAL(s, t) + 1;
+    case 2: return -(ACT_VAL(s, t) + 1);
+    case 3: return -1;
+    }
+    return 0;
+}
+
+// first-fit placement of a sparse row (cols ascending) into a comb vector;
+// returns its base. Every slot below *low is taken, so bases that would
+// put cols[0] there are skipped.
+int comb_place(int **check, int **val, int *len, int *cap, int *low, int row, int n, const int *cols, const int *vals, int width){
+    int base0 = n && *low > cols[0] ? *low - cols[0] : 0;
+    for(int base=base0;;base++){
+        int ok = 1;
+        for(int k=0;k<n && ok;k++) if(base+cols[k] < *len && (*check)[base+cols[k]] != -1) ok = 0;
+        if(!ok) continue;
+        int need = base + width;
+        if(need > *cap){
+            int ncap = *cap ? *cap : 256;
+            while(ncap < need) ncap *= 2;
+            *check = realloc(*check, ncap * sizeof(int));
+            *val = realloc(*val, ncap * sizeof(int));
+            *cap = ncap;
+        }
+        for(int i=*len;i<need;i++){ (*check)[i] = -1; (*val)[i] = 0; }
+        if(need > *len) *len = need;
+        for(int k=0;k<n;k++){ (*check)[base+cols[k]] = row; (*val)[base+cols[k]] = vals[k]; }
+        while(*low < *len && (*check)[*low] != -1) (*low)++;
+        return base;
+    }
+}
+
+void compress_tables(ParseTables *T){
+    PHASE_BEGIN();
+    T->nstates = nstates;
+    T->nprods = nprods;
+    T->nterms = nterm; T->nnonterms = nnon; T->eof = eof_sym;
+    // terminal equivalence classes by identical columns; columns are
+    // hashed first and only compared in full when the hashes agree
+    free(T->tclass);
+    T->tclass = calloc(nterm+1, sizeof(int));
+    int *rep = malloc((nterm+1) * sizeof(int)); // representative terminal of each class
+    // every entry encoded once, row by row: enc[s*nterm + t]
+    static const int mul[4] = { 0, 1, -1, 0 }, add[4] = { 0, 1, -1, -1 };
+    int *enc = malloc(((size_t)nstates * nterm + 1) * sizeof(int));
+    for(size_t i=0;i<(size_t)nstates * nterm;i++) enc[i] = mul[action_type[i]] * action_val[i] + add[action_type[i]];
+    unsigned *colh = malloc(nterm * sizeof(unsigned));
+    for(int t=0;t<nterm;t++) colh[t] = 2166136261u;
+    for(int s=0;s<nstates;s++){
+        const int *row = enc + (size_t)s * nterm;
+        for(int t=0;t<nterm;t++) colh[t] = (colh[t] ^ (unsigned)row[t]) * 16777619u;
+    }
+    T->nclasses = 1;
+    for(int t=0;t<nterm;t++){
+        int cls;
+        for(cls=1;cls<T->nclasses;cls++){
+            if(colh[rep[cls]] != colh[t]) continue;
+            int same = 1;
+            for(int s=0;s<nstates && same;s++)
+                if(enc[(size_t)s * nterm + t] != enc[(size_t)s * nterm + rep[cls]]) same = 0;
+            if(same) break;
+        }
+        if(cls == T->nclasses) rep[T->nclasses++] = t;
+        T->tclass[t] = cls;
+    }
+    free(colh);
+
+    free(T->defact); free(T->abase); free(T->acheck); free(T->aval);
+    free(T->gdef); free(T->gbase); free(T->gcheck); free(T->gval);
+    free(T->prod_lhs); free(T->prod_len); free(T->prod_text); free(T->strtab);
+    free(T->sym_text); free(T->term_len); free(T->lex_start); free(T->lex_ids);
+    free(T->cstart); free(T->cterm); free(T->cact);
+    T->defact = malloc(nstates * sizeof(int));
+    T->abase = malloc(nstates * sizeof(int));
+    T->acheck = T->aval = NULL; T->alen = 0;
+    int cap = 0, low = 0;
+    // densest rows first packs tighter
+    int *order = malloc(nstates * sizeof(int)), *cnt = malloc(nstates * sizeof(int));
+    int *cols = malloc(T->nclasses * sizeof(int)), *vals = malloc(T->nclasses * sizeof(int));
+    int *rcount = calloc(nprods, sizeof(int));  // uses of each reduction in the row
+    int *row = malloc(T->nclasses * sizeof(int));
+    for(int s=0;s<nstates;s++){
+        // default: most frequent reduction other than accept, the first
+        // such in class order on a tie
+        int best = 0, bestn = 0;
+        for(int cls=1;cls<T->nclasses;cls++){
+            row[cls] = enc[(size_t)s * nterm + rep[cls]];
+            if(row[cls] < -1) rcount[-row[cls] - 1]++;
+        }
+        for(int cls=1;cls<T->nclasses;cls++)
+            if(row[cls] < -1 && rcount[-row[cls] - 1] > bestn){ best = row[cls]; bestn = rcount[-row[cls] - 1]; }
+        cnt[s] = 0;
+        for(int cls=1;cls<T->nclasses;cls++){
+            if(row[cls] < -1) rcount[-row[cls] - 1] = 0;
+            if(row[cls] != 0 && row[cls] != best) cnt[s]++;
+        }
+        T->defact[s] = best;
+        order[s] = s;
+    }
+    for(int i=1;i<nstates;i++){
+        int s = order[i], j = i;
+        while(j > 0 && cnt[order[j-1]] < cnt[s]){ order[j] = order[j-1]; j--; }
+        order[j] = s;
+    }
+    for(int i=0;i<nstates;i++){
+        int s = order[i], n = 0;
+        for(int cls=1;cls<T->nclasses;cls++){
+            int v = enc[(size_t)s * nterm + rep[cls]];
+            if(v == 0 || v == T->defact[s]) continue;
+            cols[n] = cls; vals[n] = v; n++;
+        }
+        T->abase[s] = comb_place(&T->acheck, &T->aval, &T->alen, &cap, &low, s, n, cols, vals, T->nclasses);
+    }
+    free(order); free(cnt); free(cols); free(vals); free(rep); free(rcount); free(row); free(enc);
+
+    // GOTO columns around the most common target
+    T->gdef = malloc(nnon * sizeof(int));
+    T->gbase = malloc(nnon * sizeof(int));
+    T->gcheck = T->gval = NULL; T->glen = 0; cap = 0; low = 0;
+    // columns gathered in one pass over the rows: the states with a goto on
+    // A, in order, are gs[gstart[A]..gstart[A+1]), their targets gv[...]
+    int *gstart = calloc(nnon + 1, sizeof(int));
+    for(int s=0;s<nstates;s++)
+        for(int A=0;A<nnon;A++) if(GOTO(s, nterm+A) != -1) gstart[A+1]++;
+    for(int A=0;A<nnon;A++) gstart[A+1] += gstart[A];
+    int *gs = malloc((gstart[nnon] + 1) * sizeof(int)), *gv = malloc((gstart[nnon] + 1) * sizeof(int));
+    int *gfill = malloc(nnon * sizeof(int));
+    memcpy(gfill, gstart, nnon * sizeof(int));
+    for(int s=0;s<nstates;s++)
+        for(int A=0;A<nnon;A++)
+            if(GOTO(s, nterm+A) != -1){ gs[gfill[A]] = s; gv[gfill[A]++] = GOTO(s, nterm+A); }
+    int *gcols = malloc(nstates * sizeof(int)), *gvals = malloc(nstates * sizeof(int));
+    int *gcount = calloc(nstates, sizeof(int));
+    for(int A=0;A<nnon;A++){
+        int best = -1, bestn = 0;
+        for(int k=gstart[A];k<gstart[A+1];k++) gcount[gv[k]]++;
+        for(int k=gstart[A];k<gstart[A+1];k++)
+            if(gcount[gv[k]] > bestn){ best = gv[k]; bestn = gcount[gv[k]]; }
+        for(int k=gstart[A];k<gstart[A+1];k++) gcount[gv[k]] = 0;
+        T->gdef[A] = best;
+        int n = 0;
+        for(int k=gstart[A];k<gstart[A+1];k++){
+            if(gv[k] == best) continue;
+            gcols[n] = gs[k]; gvals[n] = gv[k]; n++;
+        }
+        T->gbase[A] = comb_place(&T->gcheck, &T->gval, &T->glen, &cap, &low, A, n, gcols, gvals, nstates);
+    }
+    free(gcols); free(gvals); free(gcount); free(gstart); free(gs); free(gv); free(gfill);
+
+    // production texts and symbol names share the string table
+    T->prod_lhs = malloc(nprods * sizeof(int));
+    T->prod_len = malloc(nprods * sizeof(int));
+    T->prod_text = malloc(nprods * sizeof(int));
+    T->sym_text = malloc(nsyms * sizeof(int));
+    size_t bytes = 0;
+    for(int p=0;p<nprods;p++) bytes += strlen(prods[p].name) + strlen(prods[p].alt) + 3;
+    for(int X=0;X<nsyms;X++) bytes += strlen(sym_name[X]) + 1;
+    T->strtab = malloc(bytes);
+    T->strbytes = 0;
+    for(int p=0;p<nprods;p++){
+        T->prod_lhs[p] = NT(prods[p].lhs); T->prod_len[p] = prod_len(p);
+        T->prod_text[p] = T->strbytes;
+        T->strbytes += sprintf(T->strtab + T->strbytes, "%s->%s", prods[p].name, prods[p].alt) + 1;
+    }
+    for(int X=0;X<nsyms;X++){
+        T->sym_text[X] = T->strbytes;
+        T->strbytes += sprintf(T->strtab + T->strbytes, "%s", sym_name[X]) + 1;
+    }
+
+    // lexer buckets: terminals by first byte, longest name first
+    T->term_len = malloc(nterm * sizeof(int));
+    T->lex_start = calloc(257, sizeof(int));
+    T->lex_ids = malloc(nterm * sizeof(int));
+    for(int t=0;t<nterm;t++){
+        T->term_len[t] = strlen(sym_name[t]);
+        T->lex_start[(unsigned char)sym_name[t][0]+1]++;
+    }
+    for(int c=0;c<256;c++) T->lex_start[c+1] += T->lex_start[c];
+    int fill[256];
+    memcpy(fill, T->lex_start, sizeof(fill));
+    for(int t=0;t<nterm;t++) T->lex_ids[fill[(unsigned char)sym_name[t][0]]++] = t;
+    for(int c=0;c<256;c++){
+        for(int k=T->lex_start[c]+1;k<T->lex_start[c+1];k++){
+            int t = T->lex_ids[k], j = k;
+            while(j > T->lex_start[c] && T->term_len[T->lex_ids[j-1]] < T->term_len[t]){ T->lex_ids[j] = T->lex_ids[j-1]; j--; }
+            T->lex_ids[j] = t;
+        }
+    }
+
+    T->nconf = nconf;
+    T->cstart = malloc((nstates + 1) * sizeof(int));
+    T->cterm = malloc((nconf + 1) * sizeof(int));
+    T->cact = malloc((nconf + 1) * sizeof(int));
+    memcpy(T->cstart, conf_start, (nstates + 1) * sizeof(int));
+    if(nconf){
+        memcpy(T->cterm, conf_term, nconf * sizeof(int));
+        memcpy(T->cact, conf_act, nconf * sizeof(int));
+    }
+    PHASE_END(COMPRESS);
+}
+
+// Binary table file: a header followed by the ParseTables arrays, each
+// 4-byte aligned and addressed by its offset from the start of the file,
+// so a mapping of the file can be used in place wherever it lands.
+#define TBL_MAGIC "SLRTBL\0"
+#define TBL_VERSION 3
+enum { SEC_TCLASS, SEC_DEFACT, SEC_ABASE, SEC_ACHECK, SEC_AVAL, SEC_GDEF, SEC_GBASE,
+       SEC_GCHECK, SEC_GVAL, SEC_PLHS, SEC_PLEN, SEC_PTEXT, SEC_SYMTEXT, SEC_TLEN,
+       SEC_LEXSTART, SEC_LEXIDS, SEC_CSTART, SEC_CTERM, SEC_CACT, SEC_STRTAB, NSECT };
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;              // total file bytes
+    int32_t nstates, nclasses, nprods, alen, glen, strbytes;
+    int32_t nterms, nnonterms, eof, nconf;
+    uint32_t off[NSECT];
+} TableFileHeader;
+
+// section pointers and byte sizes of a table set
+void table_sections(const ParseTables *T, const void *ptr[NSECT], size_t bytes[NSECT]){
+    const void *p[NSECT] = { T->tclass, T->defact, T->abase, T->acheck, T->aval, T->gdef, T->gbase,
+                             T->gcheck, T->gval, T->prod_lhs, T->prod_len, T->prod_text, T->sym_text,
+                             T->term_len, T->lex_start, T->lex_ids, T->cstart, T->cterm, T->cact,
+                             T->strtab };
+    size_t b[NSECT] = { (T->nterms + 1) * sizeof(int), T->nstates * sizeof(int), T->nstates * sizeof(int),
+                        T->alen * sizeof(int), T->alen * sizeof(int), T->nnonterms * sizeof(int),
+                        T->nnonterms * sizeof(int), T->glen * sizeof(int), T->glen * sizeof(int),
+                        T->nprods * sizeof(int), T->nprods * sizeof(int), T->nprods * sizeof(int),
+                        (T->nterms + T->nnonterms) * sizeof(int), T->nterms * sizeof(int),
+                        257 * sizeof(int), T->nterms * sizeof(int), (T->nstates + 1) * sizeof(int),
+                        T->nconf * sizeof(int), T->nconf * sizeof(int), T->strbytes };
+    memcpy(ptr, p, sizeof(p));
+    memcpy(bytes, b, sizeof(b));
+}
+
+int save_tables(const ParseTables *T, const char *path){
+    const void *ptr[NSECT]; size_t bytes[NSECT];
+    table_sections(T, ptr, bytes);
+    TableFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TBL_MAGIC, sizeof(h.magic));
+    h.version = TBL_VERSION;
+    h.nstates = T->nstates; h.nclasses = T->nclasses; h.nprods = T->nprods;
+    h.alen = T->alen; h.glen = T->glen; h.strbytes = T->strbytes;
+    h.nterms = T->nterms; h.nnonterms = T->nnonterms; h.eof = T->eof; h.nconf = T->nconf;
+    size_t off = sizeof(h);
+    for(int i=0;i<NSECT;i++){ h.off[i] = off; off += (bytes[i] + 3) & ~(size_t)3; }
+    h.size = off;
+
+    FILE *f = fopen(path, "wb");
+    if(!f){ perror(path); return -1; }
+    static const char pad[4];
+    fwrite(&h, sizeof(h), 1, f);
+    for(int i=0;i<NSECT;i++){
+        fwrite(ptr[i], 1, bytes[i], f);
+        fwrite(pad, 1, ((bytes[i] + 3) & ~(size_t)3) - bytes[i], f);
+    }
+    if(fclose(f) != 0){ perror(path); return -1; }
+    return 0;
+}
+
+// an encoded action: shift to a state, accept, reduce by a production or error
+int action_valid(const ParseTables *T, int v){
+    return v >= -T->nprods && v <= T->nstates;
+}
+
+// every index the parsers and the lexer take from the tables is in range,
+// so a damaged file is caught once here instead of at each lookup. (Only
+// the stack depth a reduction needs is left to the parsers, which reject
+// one that would pop the whole stack.)
+int tables_valid(const ParseTables *T){
+    for(int t=0;t<=T->nterms;t++) if(T->tclass[t] < 0 || T->tclass[t] >= T->nclasses) return 0;
+    for(int s=0;s<T->nstates;s++)
+        if(T->abase[s] < 0 || T->abase[s] > T->alen - T->nclasses || !action_valid(T, T->defact[s])) return 0;
+    for(int i=0;i<T->alen;i++) if(!action_valid(T, T->aval[i])) return 0;
+    for(int A=0;A<T->nnonterms;A++)
+        if(T->gbase[A] < 0 || T->gbase[A] > T->glen - T->nstates || T->gdef[A] < -1 || T->gdef[A] >= T->nstates) return 0;
+    for(int i=0;i<T->glen;i++) if(T->gval[i] < -1 || T->gval[i] >= T->nstates) return 0;
+    // strings are NUL-terminated inside the string table
+    if(T->strtab[T->strbytes-1] != 0) return 0;
+    for(int p=0;p<T->nprods;p++)
+        if(T->prod_lhs[p] < 0 || T->prod_lhs[p] >= T->nnonterms || T->prod_len[p] < 0
+           || T->prod_text[p] < 0 || T->prod_text[p] >= T->strbytes) return 0;
+    for(int X=0;X<T->nterms+T->nnonterms;X++) if(T->sym_text[X] < 0 || T->sym_text[X] >= T->strbytes) return 0;
+    for(int t=0;t<T->nterms;t++) if(T->term_len[t] < 1 || T->term_len[t] >= T->strbytes - T->sym_text[t]) return 0;
+    if(T->lex_start[0] != 0 || T->lex_start[256] > T->nterms) return 0;
+    for(int c=0;c<256;c++) if(T->lex_start[c+1] < T->lex_start[c]) return 0;
+    for(int k=0;k<T->lex_start[256];k++) if(T->lex_ids[k] < 0 || T->lex_ids[k] >= T->nterms) return 0;
+    if(T->cstart[0] != 0 || T->cstart[T->nstates] > T->nconf) return 0;
+    for(int s=0;s<T->nstates;s++) if(T->cstart[s+1] < T->cstart[s]) return 0;
+    for(int k=0;k<T->nconf;k++) if(!action_valid(T, T->cact[k])) return 0;
+    return 1;
+}
+
+// map a table file read-only and point T's arrays into it
+int load_tables(ParseTables *T, const char *path){
+    int fd = open(path, O_RDONLY);
+    if(fd < 0){ perror(path); return -1; }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(TableFileHeader)){
+        fprintf(stderr, "%s: not a table file\n", path); close(fd); return -1;
+    }
+    char *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED){ perror(path); return -1; }
+    const TableFileHeader *h = (const TableFileHeader *)base;
+    if(memcmp(h->magic, TBL_MAGIC, sizeof(h->magic)) != 0 || h->size != (uint32_t)st.st_size){
+        fprintf(stderr, "%s: not a table file\n", path); munmap(base, st.st_size); return -1;
+    }
+    if(h->version != TBL_VERSION){
+        fprintf(stderr, "%s: table format version %u, expected %d\n", path, h->version, TBL_VERSION);
+        munmap(base, st.st_size); return -1;
+    }
+    memset(T, 0, sizeof(*T));
+    T->nstates = h->nstates; T->nclasses = h->nclasses; T->nprods = h->nprods;
+    T->alen = h->alen; T->glen = h->glen; T->strbytes = h->strbytes;
+    T->nterms = h->nterms; T->nnonterms = h->nnonterms; T->eof = h->eof; T->nconf = h->nconf;
+    // counts first: the section sizes below are computed from them
+    const int32_t count[] = { h->nstates, h->nclasses, h->nprods, h->alen, h->glen, h->strbytes,
+                              h->nterms, h->nnonterms, h->nconf };
+    int bad = h->nstates < 1 || h->nclasses < 1 || h->nprods < 1 || h->strbytes < 1
+           || h->eof < 0 || h->eof >= h->nterms;
+    for(int i=0;i<(int)(sizeof(count)/sizeof(count[0]));i++) if(count[i] < 0 || (uint32_t)count[i] > h->size) bad = 1;
+    if(bad){
+        fprintf(stderr, "%s: corrupt table file\n", path); munmap(base, st.st_size); return -1;
+    }
+    const void *ptr[NSECT]; size_t bytes[NSECT];
+    table_sections(T, ptr, bytes);
+    for(int i=0;i<NSECT;i++){
+        if(h->off[i] % 4 || (size_t)h->off[i] + bytes[i] > h->size){
+            fprintf(stderr, "%s: corrupt table file\n", path); munmap(base, st.st_size); return -1;
+        }
+    }
+    T->tclass = (int *)(base + h->off[SEC_TCLASS]);
+    T->defact = (int *)(base + h->off[SEC_DEFACT]);
+    T->abase = (int *)(base + h->off[SEC_ABASE]);
+    T->acheck = (int *)(base + h->off[SEC_ACHECK]);
+    T->aval = (int *)(base + h->off[SEC_AVAL]);
+    T->gdef = (int *)(base + h->off[SEC_GDEF]);
+    T->gbase = (int *)(base + h->off[SEC_GBASE]);
+    T->gcheck = (int *)(base + h->off[SEC_GCHECK]);
+    T->gval = (int *)(base + h->off[SEC_GVAL]);
+    T->prod_lhs = (int *)(base + h->off[SEC_PLHS]);
+    T->prod_len = (int *)(base + h->off[SEC_PLEN]);
+    T->prod_text = (int *)(base + h->off[SEC_PTEXT]);
+    T->sym_text = (int *)(base + h->off[SEC_SYMTEXT]);
+    T->term_len = (int *)(base + h->off[SEC_TLEN]);
+    T->lex_start = (int *)(base + h->off[SEC_LEXSTART]);
+    T->lex_ids = (int *)(base + h->off[SEC_LEXIDS]);
+    T->cstart = (int *)(base + h->off[SEC_CSTART]);
+    T->cterm = (int *)(base + h->off[SEC_CTERM]);
+    T->cact = (int *)(base + h->off[SEC_CACT]);
+    T->strtab = base + h->off[SEC_STRTAB];
+    if(!tables_valid(T)){
+        fprintf(stderr, "%s: corrupt table file\n", path); munmap(base, st.st_size); return -1;
+    }
+    return 0;
+}
+
+// write s as a C string literal, octal-escaping anything but plain characters
+void put_cstr(FILE *f, const char *s){
+    fputc('"', f);
+    for(;*s;s++){
+        unsigned char c = *s;
+        if(isalnum(c) || (c != '"' && c != '\\' && c != '?' && isprint(c))) fputc(c, f);
+        else fprintf(f, "\\%03o", c);
+    }
+    fputc('"', f);
+}
+
+// Direct-coded backend: write a standalone C++ parser for the current
+// tables. Every state becomes a label with a switch on the lookahead token
+// (terminals with the same action share case labels, the state's default
+// reduction is the default case), every reduction a block that pops its
+// compile-time constant length and jumps to its nonterminal's GOTO switch.
+// Reductions count against the same per-token budget as parse_quiet.
+int emit_cpp(const ParseTables *T, const char *path){
+    FILE *f = fopen(path, "w");
+    if(!f){ perror(path); return -1; }
+    char *used_red = calloc(nprods, 1), *used_nt = calloc(nnon, 1);
+    for(int s=0;s<nstates;s++){
+        if(T->defact[s] < -1) used_red[-T->defact[s]-1] = 1;
+        for(int t=0;t<nterm;t++){
+            int v = encode_action(s, t);
+            if(v < -1) used_red[-v-1] = 1;
+        }
+    }
+    for(int p=1;p<nprods;p++) if(used_red[p]) used_nt[NT(prods[p].lhs)] = 1;
+
+    fprintf(f, "// Generated by slr_real --emit-cpp: direct-coded LR parser.\n");
+    fprintf(f, "// Grammar:\n");
+    for(int p=0;p<nprods;p++) fprintf(f, "//   %2d: %s->%s\n", p, prods[p].name, prods[p].alt);
+    fprintf(f, "\n#include <cctype>\n#include <cstdio>\n#include <cstring>\n#include <string>\n#include <vector>\n\n");
+
+    // the same longest-match lexer as lex_token()
+    fprintf(f, "// terminals by id; lex_ids lists them by first byte, longest first,\n");
+    fprintf(f, "// byte c's candidates starting at lex_start[c]\n");
+    fprintf(f, "static const char *const term_name[] = {");
+    for(int t=0;t<nterm;t++){ fprintf(f, t % 8 ? " " : "\n    "); put_cstr(f, sym_name[t]); fputc(',', f); }
+    fprintf(f, "\n};\nstatic const int term_len[] = {");
+    for(int t=0;t<nterm;t++) fprintf(f, "%s%d,", t % 16 ? " " : "\n    ", T->term_len[t]);
+    fprintf(f, "\n};\nstatic const int lex_start[257] = {");
+    for(int c=0;c<257;c++) fprintf(f, "%s%d,", c % 16 ? " " : "\n    ", T->lex_start[c]);
+    fprintf(f, "\n};\nstatic const int lex_ids[] = {");
+    for(int t=0;t<nterm;t++) fprintf(f, "%s%d,", t % 16 ? " " : "\n    ", T->lex_ids[t]);
+    fprintf(f, "\n};\n\n");
+    fprintf(f, "// next token at in[pos]: %d ($) at the end, %d for a byte no terminal starts with\n", eof_sym, nterm);
+    fprintf(f, "static int next_token(const char *in, size_t &pos)\n{\n");
+    fprintf(f, "    while(in[pos] && std::isspace((unsigned char)in[pos])) ++pos;\n");
+    fprintf(f, "    if(!in[pos]) return %d;\n", eof_sym);
+    fprintf(f, "    int c = (unsigned char)in[pos];\n");
+    fprintf(f, "    for(int k = lex_start[c]; k < lex_start[c + 1]; ++k){\n");
+    fprintf(f, "        int t = lex_ids[k];\n");
+    fprintf(f, "        if(std::strncmp(in + pos, term_name[t], term_len[t]) == 0){ pos += term_len[t]; return t; }\n");
+    fprintf(f, "    }\n    ++pos;\n    return %d;\n}\n\n", nterm);
+
+    fprintf(f, "// returns true if in (terminated by NUL or '$') is a sentence of the grammar\n");
+    fprintf(f, "static bool parse(const char *in)\n{\n");
+    fprintf(f, "    std::vector<int> st(64);\n    size_t sp = 0;\n");
+    fprintf(f, "    size_t pos = 0;\n");
+    fprintf(f, "    int la = next_token(in, pos);\n");
+    fprintf(f, "    // reductions left before the next shift: resolved conflicts can\n");
+    fprintf(f, "    // leave a reduction that loops back to its own state\n");
+    fprintf(f, "    long budget = %d;\n", nstates);
+    fprintf(f, "#define PUSH(s) do { if(sp == st.size()) st.resize(2 * sp); st[sp++] = (s); } while(0)\n");
+    fprintf(f, "#define SHIFT(s) do { la = next_token(in, pos); budget = (long)(sp + 1) * %d; goto state_##s; } while(0)\n", nstates);
+    fprintf(f, "    goto state_0;\n");
+
+    char *done = malloc(nterm);
+    for(int s=0;s<nstates;s++){
+        fprintf(f, "\nstate_%d:\n    PUSH(%d);\n    switch(la){\n", s, s);
+        memset(done, 0, nterm);
+        for(int t=0;t<nterm;t++){
+            int v = encode_action(s, t);
+            if(done[t] || v == 0 || v == T->defact[s]) continue;
+            for(int u=t;u<nterm;u++){
+                if(done[u] || encode_action(s, u) != v) continue;
+                done[u] = 1;
+                fprintf(f, "    case %d: // %s\n", u, sym_name[u]);
+            }
+            if(v > 0) fprintf(f, "        SHIFT(%d);\n", v-1);
+            else if(v == -1) fprintf(f, "        return true;\n");
+            else fprintf(f, "        goto reduce_%d;\n", -v-1);
+        }
+        if(T->defact[s] < -1) fprintf(f, "    default:\n        goto reduce_%d;\n", -T->defact[s]-1);
+        else fprintf(f, "    default:\n        return false;\n");
+        fprintf(f, "    }\n");
+    }
+    free(done);
+
+    for(int p=1;p<nprods;p++){
+        if(!used_red[p]) continue;
+        fprintf(f, "\nreduce_%d: // %s->%s\n", p, prods[p].name, prods[p].alt);
+        fprintf(f, "    if(--budget < 0) return false;\n");
+        if(prod_len(p)) fprintf(f, "    sp -= %d;\n", prod_len(p));
+        fprintf(f, "    goto goto_%d;\n", NT(prods[p].lhs));
+    }
+
+    for(int A=0;A<nnon;A++){
+        if(!used_nt[A]) continue;
+        fprintf(f, "\ngoto_%d: // %s\n    switch(st[sp-1]){\n", A, sym_name[nterm+A]);
+        for(int s=0;s<nstates;s++){
+            int v = GOTO(s, nterm+A);
+            if(v != -1 && v != T->gdef[A]) fprintf(f, "    case %d: goto state_%d;\n", s, v);
+        }
+        if(T->gdef[A] != -1) fprintf(f, "    default: goto state_%d;\n    }\n", T->gdef[A]);
+        else fprintf(f, "    default: return false;\n    }\n");
+    }
+    fprintf(f, "#undef PUSH\n#undef SHIFT\n}\n\n");
+    free(used_red); free(used_nt);
+
+    fprintf(f, "int main()\n{\n");
+    fprintf(f, "    std::string line;\n    int c, n = 0, accepted = 0;\n");
+    fprintf(f, "    while((c = std::getchar()) != EOF){\n");
+    fprintf(f, "        if(c != '\\n'){ line += (char)c; continue; }\n");
+    fprintf(f, "        bool ok = parse(line.c_str());\n");
+    fprintf(f, "        std::printf(\"%%d: %%s\\n\", ++n, ok ? \"accept\" : \"reject\");\n");
+    fprintf(f, "        accepted += ok;\n        line.clear();\n    }\n");
+    fprintf(f, "    if(!line.empty()){ bool ok = parse(line.c_str()); std::printf(\"%%d: %%s\\n\", ++n, ok ? \"accept\" : \"reject\"); accepted += ok; }\n");
+    fprintf(f, "    std::printf(\"%%d of %%d accepted\\n\", accepted, n);\n");
+    fprintf(f, "    return 0;\n}\n");
+    if(fclose(f) != 0){ perror(path); return -1; }
+    return 0;
+}
+
+size_t dense_table_bytes(){
+    return (size_t)nstates * ((size_t)nterm * 2 + nsyms) * sizeof(int);
+}
+
+// (the lexer tables are shared by both layouts and not counted)
+size_t compressed_table_bytes(const ParseTables *T){
+    return (size_t)(T->nterms + 1) * sizeof(int) + (size_t)T->nnonterms * 2 * sizeof(int)
+         + (size_t)T->nstates * 2 * sizeof(int)
+         + (size_t)T->alen * 2 * sizeof(int)
+         + (size_t)T->glen * 2 * sizeof(int)
+         + (size_t)T->nprods * 2 * sizeof(int);
+}
+
+// growable state stack for the parsers
+typedef struct {
+    int *s;
+    int top, cap;
+} StateStack;
+
+void stack_grow(StateStack *S){
+    S->cap = S->cap ? 2*S->cap : 256;
+    S->s = realloc(S->s, S->cap * sizeof(int));
+}
+
+#define STACK_PUSH(S, v) do { if((S)->top == (S)->cap) stack_grow(S); (S)->s[(S)->top++] = (v); } while(0)
+
+// quiet recognizers over both layouts: 1 if accepted; *ntokens and
+// *nreduce (if given) get the number of tokens consumed, end marker
+// included, and of reductions made. Both reject after top*nstates
+// reductions on one token, as parse_input does.
+int parse_quiet_dense(StateStack *S, const char *in){
+    int pos = 0, end = strlen(in);
+    int a = lex_token(&ptab, in, &pos, end, NULL);
+    S->top = 0;
+    STACK_PUSH(S, 0);
+    long budget = (long)S->top * nstates;
+    for(;;){
+        int s = S->s[S->top-1];
+        int t = a < nterm ? ACT_TYPE(s, a) : 0;
+        if(t == 1){
+            STACK_PUSH(S, ACT_VAL(s, a));
+            a = lex_token(&ptab, in, &pos, end, NULL);
+            budget = (long)S->top * nstates;
+        } else if(t == 2){
+            int p = ACT_VAL(s, a);
+            if(--budget < 0) return 0;
+            S->top -= prod_len(p);
+            int nxt = GOTO(S->s[S->top-1], prods[p].lhs);
+            if(nxt == -1) return 0;
+            STACK_PUSH(S, nxt);
+        } else return t == 3;
+    }
+}
+
+int parse_quiet(const ParseTables *T, StateStack *S, const char *in, long *ntokens, long *nreduce){
+    int pos = 0, end = strlen(in);
+    int a = lex_token(T, in, &pos, end, NULL);
+    long n = 1, nr = 0;
+    int ok;
+    S->top = 0;
+    STACK_PUSH(S, 0);
+    long budget = (long)S->top * T->nstates;
+    for(;;){
+        int v = tbl_action(T, S->s[S->top-1], a);
+        if(v > 0){
+            STACK_PUSH(S, v - 1);
+            a = lex_token(T, in, &pos, end, NULL); n++;
+            budget = (long)S->top * T->nstates;
+            STAT(SHIFTS);
+        } else if(v < -1){
+            int p = -v - 1;
+            if(--budget < 0 || T->prod_len[p] >= S->top){ ok = 0; break; }
+            S->top -= T->prod_len[p];
+            int nxt = tbl_goto(T, S->s[S->top-1], T->prod_lhs[p]);
+            if(nxt == -1){ ok = 0; break; }
+            STACK_PUSH(S, nxt); nr++;
+            STAT(REDUCTIONS);
+        } else { ok = v == -1; break; }
+    }
+    if(ntokens) *ntokens += n;
+    if(nreduce) *nreduce += nr;
+    return ok;
+}
+
+// Parse trees (--tree). Every shift adds a leaf for its token and every
+// reduction an interior node over the nodes it pops, in the same loop as
+// parse_quiet. Nodes are bump-allocated from one growable array and refer
+// to each other by index; the children of a node are a contiguous run of
+// the kids array, left to right. The whole tree goes at once, by
+// tree_reset for the next parse or tree_free. (With --unit-elim the
+// bypassed unit reductions leave no node, as in an abstract tree.)
+typedef struct {
+    int sym;            // symbol id, a terminal for leaves
+    int prod;           // production of an interior node, -1 for a leaf
+    int start, end;     // input text covered
+    int kids, nkids;    // children are kids[kids..kids+nkids)
+} TreeNode;
+
+typedef struct {
+    TreeNode *node;
+    int nnodes, nodecap;
+    int *kids;
+    int nkids, kidcap;
+} ParseTree;
+
+int tree_node(ParseTree *P, int sym, int prod, int start, int end){
+    if(P->nnodes == P->nodecap){
+        P->nodecap = P->nodecap ? 2*P->nodecap : 256;
+        P->node = realloc(P->node, P->nodecap * sizeof(TreeNode));
+    }
+    TreeNode *n = &P->node[P->nnodes];
+    n->sym = sym; n->prod = prod; n->start = start; n->end = end;
+    n->kids = P->nkids; n->nkids = 0;
+    return P->nnodes++;
+}
+
+// interior node for production p over children c[0..n); an empty one
+// sits at offset at
+int tree_reduce(ParseTree *P, const ParseTables *T, int p, const int *c, int n, int at){
+    if(P->nkids + n > P->kidcap){
+        while(P->nkids + n > P->kidcap) P->kidcap = P->kidcap ? 2*P->kidcap : 256;
+        P->kids = realloc(P->kids, P->kidcap * sizeof(int));
+    }
+    int start = n ? P->node[c[0]].start : at, end = n ? P->node[c[n-1]].end : at;
+    int x = tree_node(P, T->nterms + T->prod_lhs[p], p, start, end);
+    if(n) memcpy(P->kids + P->nkids, c, n * sizeof(int));
+    P->node[x].nkids = n;
+    P->nkids += n;
+    return x;
+}
+
+void tree_reset(ParseTree *P){ P->nnodes = P->nkids = 0; }
+
+void tree_free(ParseTree *P){
+    free(P->node); free(P->kids);
+    memset(P, 0, sizeof(*P));
+}
+
+size_t tree_bytes(const ParseTree *P){
+    return (size_t)P->nodecap * sizeof(TreeNode) + (size_t)P->kidcap * sizeof(int);
+}
+
+// parse in into P; returns the root, or -1 if in is rejected. V is the
+// stack of tree nodes alongside the state stack S.
+int parse_tree(const ParseTables *T, StateStack *S, StateStack *V, ParseTree *P, const char *in,
+               long *ntokens, long *nreduce){
+    int pos = 0, end = strlen(in), start;
+    int a = lex_token(T, in, &pos, end, &start);
+    long n = 1, nr = 0;
+    int root;
+    tree_reset(P);
+    S->top = V->top = 0;
+    STACK_PUSH(S, 0);
+    long budget = (long)S->top * T->nstates;    // as in parse_quiet
+    for(;;){
+        int v = tbl_action(T, S->s[S->top-1], a);
+        if(v > 0){
+            STACK_PUSH(S, v - 1);
+            STACK_PUSH(V, tree_node(P, a, -1, start, pos));
+            a = lex_token(T, in, &pos, end, &start); n++;
+            budget = (long)S->top * T->nstates;
+            STAT(SHIFTS);
+        } else if(v < -1){
+            int p = -v - 1, len = T->prod_len[p];
+            if(--budget < 0 || len >= S->top){ root = -1; break; }
+            S->top -= len; V->top -= len;
+            int nxt = tbl_goto(T, S->s[S->top-1], T->prod_lhs[p]);
+            if(nxt == -1){ root = -1; break; }
+            int x = tree_reduce(P, T, p, V->s + V->top, len, start);
+            STACK_PUSH(S, nxt);
+            STACK_PUSH(V, x);
+            nr++;
+            STAT(REDUCTIONS);
+        } else { root = v == -1 ? V->s[V->top-1] : -1; break; }
+    }
+    if(ntokens) *ntokens += n;
+    if(nreduce) *nreduce += nr;
+    return root;
+}
+
+void print_tree(const ParseTables *T, const ParseTree *P, const char *in, int x, int depth){
+    const TreeNode *n = &P->node[x];
+    printf("%*s", 2*depth, "");
+    if(n->prod < 0) printf("%s '%.*s'\n", T->strtab + T->sym_text[n->sym], n->end - n->start, in + n->start);
+    else printf("%s\n", T->strtab + T->prod_text[n->prod]);
+    for(int k=0;k<n->nkids;k++) print_tree(T, P, in, P->kids[n->kids + k], depth + 1);
+}
+
+// build and print the tree for one input
+void report_tree(const ParseTables *T, const char *input){
+    StateStack S = {0}, V = {0};
+    ParseTree P = {0};
+    double t0 = now_sec();
+    int root = parse_tree(T, &S, &V, &P, input, NULL, NULL);
+    double us = (now_sec()-t0) * 1e6;
+    if(root < 0) printf("\nNo parse tree: input rejected\n");
+    else {
+        printf("\nParse tree (%d nodes, %zu arena bytes, built in %.1f us):\n", P.nnodes, tree_bytes(&P), us);
+        print_tree(T, &P, input, root, 0);
+    }
+    tree_free(&P);
+    free(S.s); free(V.s);
+}
+
+// Generalized LR (--glr). Where the table has a conflict every action is
+// followed, on a graph-structured stack: the nodes made for one input
+// token form a level, a level has at most one node per state (stacks
+// reaching the same state merge), and an edge points from a node to the
+// node below it, so stacks share their common parts. Work per token is
+// bounded by the number of states and paths, not by the number of parses.
+// Levels are contiguous runs of the node arena. Reductions are queued per
+// node; when a node that was already reduced from gets another edge, the
+// reductions through the new edge are queued again (for every reduced
+// node of the level once edges run within the level, as nullable
+// reductions make them).
+// Deterministic stretches skip the graph, as in Elkhound: while there is
+// one stack and its entries are not conflicted, the plain LR loop runs on
+// an array of states above a single node, base. A reduction deeper than
+// the array pops on into the graph if the path below base is plain
+// (ddepth counts the single-edge nodes below a node); otherwise, or on a
+// conflict, the array becomes a chain of nodes and the level is handled
+// in general. So does a token that takes more reductions than the stack
+// could need, which only a cyclic grammar (A =>+ A) does: the plain loop
+// would go round forever where the general case merges.
+// A level that needs the general case keeps its edges in an open-addressed
+// set keyed by (from, to) to find repeated reductions; entries from older
+// levels count as free slots, so the set is only cleared between parses.
+typedef struct {
+    int state;
+    int edge;       // first edge, -1 for the bottom node
+    int ddepth;     // nodes below reachable through single edges
+} GssNode;
+
+typedef struct {
+    int from, to, next;
+} GssEdge;
+
+typedef struct {
+    GssNode *node;
+    int nnodes, nodecap;
+    GssEdge *edge;
+    int nedges, edgecap;
+    int *eset, esetcap;     // edge set, -1 for never used
+    int nset, set_used;     // entries from the current level; set touched this parse
+    int *at, atcap;         // per state: its node in the level being built (checked on use)
+    int *work, nwork, workcap;  // (node, edge) pairs still to reduce through
+    int level, done;        // first node of the current level, first not yet reduced from
+    StateStack chain;       // base's state, then the states above it on the fast path
+    int intra;              // the current level has edges within itself
+    long nreduce;
+    int width, fast;        // widest level, tokens handled on the fast path
+} GlrStack;
+
+int gss_node(GlrStack *G, int state){
+    if(G->nnodes == G->nodecap){
+        G->nodecap = G->nodecap ? 2*G->nodecap : 1024;
+        G->node = realloc(G->node, G->nodecap * sizeof(GssNode));
+    }
+    GssNode *n = &G->node[G->nnodes];
+    n->state = state; n->edge = -1; n->ddepth = 0;
+    G->at[state] = G->nnodes;
+    return G->nnodes++;
+}
+
+// edge from -> to, not entered in the edge set
+int gss_link(GlrStack *G, int from, int to){
+    if(G->nedges == G->edgecap){
+        G->edgecap = G->edgecap ? 2*G->edgecap : 1024;
+        G->edge = realloc(G->edge, G->edgecap * sizeof(GssEdge));
+    }
+    GssNode *n = &G->node[from];
+    GssEdge *e = &G->edge[G->nedges];
+    e->from = from; e->to = to; e->next = n->edge;
+    n->ddepth = n->edge == -1 ? G->node[to].ddepth + 1 : 0;
+    n->edge = G->nedges;
+    return G->nedges++;
+}
+
+// slot of edge from->to in the edge set, or of the free slot it would take
+int gss_edge_slot(const GlrStack *G, int from, int to){
+    unsigned i = ((unsigned)from * 2654435761u ^ (unsigned)to * 40503u) & (G->esetcap - 1);
+    for(;;i=(i+1)&(G->esetcap-1)){
+        int e = G->eset[i];
+        if(e == -1 || G->edge[e].from < G->level) return i;
+        if(G->edge[e].from == from && G->edge[e].to == to) return i;
+    }
+}
+
+void gss_set_add(GlrStack *G, int e){
+    if(2 * (G->nset + 1) > G->esetcap){
+        // grow, keeping the current level's entries
+        int *old = G->eset, oldcap = G->esetcap;
+        G->esetcap = G->esetcap ? 2*G->esetcap : 1024;
+        G->eset = malloc(G->esetcap * sizeof(int));
+        for(int i=0;i<G->esetcap;i++) G->eset[i] = -1;
+        for(int i=0;i<oldcap;i++)
+            if(old[i] != -1 && G->edge[old[i]].from >= G->level)
+                G->eset[gss_edge_slot(G, G->edge[old[i]].from, G->edge[old[i]].to)] = old[i];
+        free(old);
+    }
+    G->eset[gss_edge_slot(G, G->edge[e].from, G->edge[e].to)] = e;
+    G->nset++;
+}
+
+// the current level goes general: enter its edges so far in the set
+void gss_set_level(GlrStack *G){
+    G->nset = 0; G->set_used = 1;
+    for(int v=G->level;v<G->nnodes;v++)
+        for(int e=G->node[v].edge;e!=-1;e=G->edge[e].next) gss_set_add(G, e);
+}
+
+// node for state in the level starting at node lo, or -1
+int gss_find(const GlrStack *G, int lo, int state){
+    int v = G->at[state];
+    return v >= lo && v < G->nnodes && G->node[v].state == state ? v : -1;
+}
+
+void gss_queue(GlrStack *G, int v, int e){
+    if(G->nwork + 2 > G->workcap){
+        G->workcap = G->workcap ? 2*G->workcap : 256;
+        G->work = realloc(G->work, G->workcap * sizeof(int));
+    }
+    G->work[G->nwork++] = v; G->work[G->nwork++] = e;
+}
+
+// actions of state s on token t: the conflict list if the entry has one,
+// else the single table action
+int glr_actions(const ParseTables *T, int s, int t, const int **acts, int *one){
+    for(int k=T->cstart[s];k<T->cstart[s+1];k++){
+        if(T->cterm[k] != t) continue;
+        int n = 0;
+        while(k + n < T->cstart[s+1] && T->cterm[k+n] == t) n++;
+        *acts = T->cact + k;
+        return n;
+    }
+    *one = tbl_action(T, s, t);
+    *acts = one;
+    return 1;
+}
+
+// reduction by p whose rhs was popped down to node x
+void glr_reduce_to(const ParseTables *T, GlrStack *G, int x, int p){
+    G->nreduce++;
+    STAT(REDUCTIONS);
+    int g = tbl_goto(T, G->node[x].state, T->prod_lhs[p]);
+    if(g == -1) return;
+    int w = gss_find(G, G->level, g);
+    if(x >= G->level) G->intra = 1;
+    if(w == -1){
+        w = gss_node(G, g);
+        gss_set_add(G, gss_link(G, w, x));
+        return;
+    }
+    int slot = gss_edge_slot(G, w, x), e = G->eset[slot];
+    if(e != -1 && G->edge[e].from == w && G->edge[e].to == x) return;
+    e = gss_link(G, w, x);
+    gss_set_add(G, e);
+    // a second edge: stacks through the level's nodes are no longer plain
+    for(int v=G->level;v<G->nnodes;v++) G->node[v].ddepth = 0;
+    if(!G->intra){ if(w < G->done) gss_queue(G, w, e); }
+    else for(int v=G->level;v<G->done;v++) gss_queue(G, v, e);
+}
+
+// follow every path of len edges down from x that uses edge e (any path
+// if e is -1) and reduce by p at its end
+void glr_paths(const ParseTables *T, GlrStack *G, int x, int len, int e, int p){
+    for(int f=G->node[x].edge;f!=-1;f=G->edge[f].next){
+        // without edges inside the level, e can only be the first step
+        if(e != -1 && !G->intra && f != e) continue;
+        int ne = f == e ? -1 : e;
+        if(len == 1){ if(ne == -1) glr_reduce_to(T, G, G->edge[f].to, p); }
+        else glr_paths(T, G, G->edge[f].to, len - 1, ne, p);
+    }
+}
+
+// all reductions of node v on token t, only those through edge e if e != -1
+void glr_reduce(const ParseTables *T, GlrStack *G, int v, int t, int e){
+    const int *acts; int one;
+    int n = glr_actions(T, G->node[v].state, t, &acts, &one);
+    for(int k=0;k<n;k++){
+        if(acts[k] >= -1) continue;
+        int p = -acts[k] - 1, len = T->prod_len[p];
+        if(len == 0){ if(e == -1) glr_reduce_to(T, G, v, p); }
+        else glr_paths(T, G, v, len, e, p);
+    }
+}
+
+void glr_reset(GlrStack *G, const ParseTables *T){
+    if(G->atcap < T->nstates){
+        G->at = realloc(G->at, T->nstates * sizeof(int));
+        for(int s=G->atcap;s<T->nstates;s++) G->at[s] = -1;
+        G->atcap = T->nstates;
+    }
+    if(G->set_used) for(int i=0;i<G->esetcap;i++) G->eset[i] = -1;
+    G->nnodes = G->nedges = G->nwork = G->nset = G->set_used = 0;
+    G->nreduce = 0; G->width = 1; G->fast = 0;
+}
+
+void glr_free(GlrStack *G){
+    free(G->node); free(G->edge); free(G->eset); free(G->at); free(G->work); free(G->chain.s);
+    memset(G, 0, sizeof(*G));
+}
+
+// GLR recognizer, counting like parse_quiet
+int parse_glr(const ParseTables *T, GlrStack *G, const char *in, long *ntokens, long *nreduce){
+    int pos = 0, end = strlen(in);
+    int a = lex_token(T, in, &pos, end, NULL);
+    long n = 1;
+    int ok = 0, stop = 0;
+    StateStack *S = &G->chain;
+    glr_reset(G, T);
+    G->level = G->done = 0;
+    gss_node(G, 0);
+    for(;;){
+        if(G->nnodes - G->level == 1){
+            // fast path on base and the states above it
+            int base = G->level;
+            S->top = 0;
+            STACK_PUSH(S, G->node[base].state);
+            long budget = (long)S->top * T->nstates;
+            for(;;){
+                int s = S->s[S->top-1];
+                if(T->cstart[s] != T->cstart[s+1]) break;
+                int act = tbl_action(T, s, a);
+                if(act > 0){
+                    STACK_PUSH(S, act - 1);
+                    a = lex_token(T, in, &pos, end, NULL); n++;
+                    G->fast++;
+                    STAT(SHIFTS);
+                    budget = (long)S->top * T->nstates;
+                } else if(act < -1){
+                    int p = -act - 1, len = T->prod_len[p];
+                    if(--budget < 0) break;
+                    if(len >= S->top){
+                        // into the graph below base
+                        if(G->node[base].ddepth < len - S->top + 1) break;
+                        for(int k=S->top-1;k<len;k++) base = G->edge[G->node[base].edge].to;
+                        S->top = 1;
+                        S->s[0] = G->node[base].state;
+                    } else S->top -= len;
+                    int g = tbl_goto(T, S->s[S->top-1], T->prod_lhs[p]);
+                    G->nreduce++;
+                    STAT(REDUCTIONS);
+                    if(g == -1){ stop = 1; break; }
+                    STACK_PUSH(S, g);
+                } else {
+                    ok = act == -1; stop = 1;
+                    break;
+                }
+            }
+            if(stop) break;
+            for(int k=1;k<S->top;k++){
+                int w = gss_node(G, S->s[k]);
+                gss_link(G, w, base);
+                base = w;
+            }
+            S->top = 0;
+            G->level = G->done = base;
+        }
+        // general case: every reduction in the level, then every shift
+        G->intra = 0;
+        gss_set_level(G);
+        while(G->done < G->nnodes || G->nwork){
+            if(G->nwork){
+                G->nwork -= 2;
+                glr_reduce(T, G, G->work[G->nwork], a, G->work[G->nwork+1]);
+            } else glr_reduce(T, G, G->done++, a, -1);
+        }
+        int lo = G->nnodes;
+        for(int v=G->level;v<lo;v++){
+            const int *acts; int one;
+            int na = glr_actions(T, G->node[v].state, a, &acts, &one);
+            for(int k=0;k<na;k++){
+                if(acts[k] == -1) ok = 1;
+                if(acts[k] <= 0) continue;
+                int w = gss_find(G, lo, acts[k] - 1);
+                if(w == -1) w = gss_node(G, acts[k] - 1);
+                gss_link(G, w, v);
+                STAT(SHIFTS);
+            }
+        }
+        if(ok || G->nnodes == lo) break;
+        if(G->nnodes - lo > G->width) G->width = G->nnodes - lo;
+        G->level = G->done = lo;
+        a = lex_token(T, in, &pos, end, NULL); n++;
+    }
+    if(ntokens) *ntokens += n;
+    if(nreduce) *nreduce += G->nreduce;
+    return ok;
+}
+
+// table sizes and parse throughput, dense vs compressed
+void report_table_stats(const char *input){
+    size_t db = dense_table_bytes(), cb = compressed_table_bytes(&ptab);
+    StateStack S = {0};
+    printf("\nTable layout   bytes      ns/parse   (input \"%s\", %s)\n", input,
+           parse_quiet(&ptab, &S, input, NULL, NULL) ? "accepted" : "rejected");
+    int reps = 200000;
+    volatile int sink = 0;
+    double t0 = now_sec();
+    for(int r=0;r<reps;r++) sink += parse_quiet_dense(&S, input);
+    double dense_ns = (now_sec()-t0) * 1e9 / reps;
+    t0 = now_sec();
+    for(int r=0;r<reps;r++) sink += parse_quiet(&ptab, &S, input, NULL, NULL);
+    double comp_ns = (now_sec()-t0) * 1e9 / reps;
+    printf("dense       %8zu   %10.1f   (%d terminals, %d nonterminals)\n", db, dense_ns, nterm, nnon);
+    printf("compressed  %8zu   %10.1f   (%d terminal classes, %d action + %d goto comb entries)\n",
+           cb, comp_ns, ptab.nclasses-1, ptab.alen, ptab.glen);
+    free(S.s);
+}
+
+// reductions and parse time for input, with and without unit reductions
+void report_unit_stats(const ParseTables *before, const ParseTables *after, const char *input){
+    const ParseTables *T[2] = { before, after };
+    const char *name[2] = { "before", "after" };
+    StateStack S = {0};
+    printf("\nUnit reductions  reductions/parse   ns/parse   (input \"%s\")\n", input);
+    for(int k=0;k<2;k++){
+        long nr = 0;
+        int ok = parse_quiet(T[k], &S, input, NULL, &nr);
+        int reps = 200000;
+        volatile int sink = 0;
+        double t0 = now_sec();
+        for(int r=0;r<reps;r++) sink += parse_quiet(T[k], &S, input, NULL, NULL);
+        double ns = (now_sec()-t0) * 1e9 / reps;
+        printf("%-16s %16ld %10.1f   (%s)\n", name[k], nr, ns, ok ? "accepted" : "rejected");
+    }
+    free(S.s);
+}
+
+// GLR result for one input and the size of its stack graph
+void report_glr(const ParseTables *T, const char *input){
+    GlrStack G = {0};
+    long nt = 0, nr = 0;
+    double t0 = now_sec();
+    int ok = parse_glr(T, &G, input, &nt, &nr);
+    double us = (now_sec()-t0) * 1e6;
+    printf("\nGLR: %s, %ld tokens, %ld reductions in %.1f us\n", ok ? "accept" : "reject", nt, nr, us);
+    printf("stack graph: %d nodes, %d edges, widest level %d; %d of %ld tokens shifted on the fast path\n",
+           G.nnodes, G.nedges, G.width, G.fast, nt);
+    glr_free(&G);
+}
+
+// pretty print production
+void print_prod(int idx){
+    printf("%s->%s", prods[idx].name, prods[idx].alt);
+}
+
+// print s padded to a column of width w
+void print_col(const char *s, int n, int w){
+    fwrite(s, 1, n, stdout);
+    for(int i=n;i<w;i++) putchar(' ');
+}
+
+// parse input string and print table of steps
+void parse_input(const ParseTables *T, const char *input){
+    PHASE_BEGIN();
+    StateStack S = {0};
+    STACK_PUSH(&S, 0);
+    // a table whose conflicts were resolved can reduce forever without
+    // shifting (S->SS|#: S-># in a state whose goto on S is itself), and a
+    // default reduction takes such a loop on any token. As in parse_glr,
+    // allow top*nstates reductions per token.
+    long budget = (long)S.top * T->nstates;
+    // $ is implied at the end of input
+    int L = strlen(input);
+    if(L > 0 && input[L-1] == '$') L--;
+    int pos = 0, ip;
+    int a = lex_token(T, input, &pos, L, &ip);
+    char *disp = NULL; size_t dcap = 0;
+
+    printf("\n%-20s | %-20s | %-30s\n", "Stack", "Remaining Input", "Action");
+    printf("--------------------------------------------------------------------------------------\n");
+    while(1){
+        // stack display: states bottom to top
+        if(dcap < (size_t)S.top * 12 + 1){ dcap = S.top * 24 + 1; disp = realloc(disp, dcap); }
+        int dn = 0;
+        for(int i=0;i<S.top;i++) dn += sprintf(disp + dn, "%d ", S.s[i]);
+        print_col(disp, dn, 20);
+        printf(" | ");
+        fwrite(input + ip, 1, L - ip, stdout);
+        putchar('$');
+        print_col("", 0, 20 - (L - ip + 1));
+        printf(" | ");
+        // determine action: look at current state and current input token
+        int state = S.s[S.top-1];
+        int act = tbl_action(T, state, a);
+        if(act > 0){ // shift
+            printf("shift %d (on '%s')\n", act - 1, T->strtab + T->sym_text[a]);
+            STACK_PUSH(&S, act - 1);
+            a = lex_token(T, input, &pos, L, &ip);
+            budget = (long)S.top * T->nstates;
+            STAT(SHIFTS);
+        } else if(act < -1){ // reduce by production -act-1
+            int p = -act - 1;
+            if(--budget < 0){
+                printf("error -- reduction cycle\n");
+                break;
+            }
+            if(T->prod_len[p] >= S.top){
+                printf("error -- reduce by %s pops the whole stack\n", T->strtab + T->prod_text[p]);
+                break;
+            }
+            printf("reduce by %s\n", T->strtab + T->prod_text[p]);
+            S.top -= T->prod_len[p];
+            // goto from current top state on the lhs
+            int A = T->prod_lhs[p];
+            int curstate = S.s[S.top-1];
+            int nxt = tbl_goto(T, curstate, A);
+            if(nxt == -1){
+                printf("Error: no goto for state %d on %s\n", curstate, T->strtab + T->sym_text[T->nterms + A]);
+                break;
+            }
+            STACK_PUSH(&S, nxt);
+            STAT(REDUCTIONS);
+        } else if(act == -1){
+            printf("accept\n");
+            break;
+        } else {
+            printf("error -- no action\n");
+            break;
+        }
+    }
+    free(S.s);
+    free(disp);
+    PHASE_END(PARSE);
+}
+
+// Reentrant parser context: the tables are shared and read-only, each
+// thread owns its stack and counters.
+typedef struct {
+    const ParseTables *T;
+    StateStack stack;
+    GlrStack gss;
+    StateStack values;          // tree nodes, with --tree
+    ParseTree tree;
+    long ntokens, nreduce, ntree;
+} ParseCtx;
+
+int parse_ctx(ParseCtx *C, const char *input){
+    if(tree_mode){
+        int root = parse_tree(C->T, &C->stack, &C->values, &C->tree, input, &C->ntokens, &C->nreduce);
+        C->ntree += C->tree.nnodes;
+        return root >= 0;
+    }
+    if(glr_mode) return parse_glr(C->T, &C->gss, input, &C->ntokens, &C->nreduce);
+    return parse_quiet(C->T, &C->stack, input, &C->ntokens, &C->nreduce);
+}
+
+// Batch mode: parse every line of a file without tracing, report
+// accept/reject per line (in input order) and overall throughput. Lines
+// are handed out to nthreads workers in chunks; every trace_every-th line
+// (if set) is also parsed with the full trace when results are printed.
+int trace_every = 0;
+
+#define BATCH_CHUNK 1024
+
+typedef struct {
+    const ParseTables *T;
+    char **lines;
+    long nlines;
+    unsigned char *result;
+    atomic_long next;       // first line of the next unclaimed chunk
+} BatchJob;
+
+typedef struct {
+    BatchJob *job;
+    ParseCtx ctx;
+} BatchWorker;
+
+void *batch_worker(void *arg){
+    BatchWorker *W = arg;
+    BatchJob *J = W->job;
+    for(;;){
+        long lo = atomic_fetch_add(&J->next, BATCH_CHUNK);
+        if(lo >= J->nlines) break;
+        long hi = lo + BATCH_CHUNK < J->nlines ? lo + BATCH_CHUNK : J->nlines;
+        for(long i=lo;i<hi;i++) J->result[i] = parse_ctx(&W->ctx, J->lines[i]);
+    }
+    STATS_FLUSH();
+    return NULL;
+}
+
+int run_batch(const ParseTables *T, const char *path){
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if(!f){ perror(path); return 1; }
+    BatchJob J = { .T = T };
+    long lcap = 0;
+    char *line = NULL; size_t cap = 0;
+    ssize_t n;
+    while((n = getline(&line, &cap, f)) != -1){
+        while(n > 0 && (line[n-1] == '\n' || line[n-1] == '\r')) line[--n] = 0;
+        if(J.nlines == lcap){
+            lcap = lcap ? 2*lcap : 1024;
+            J.lines = realloc(J.lines, lcap * sizeof(char *));
+        }
+        J.lines[J.nlines++] = strdup(line);
+    }
+    if(f != stdin) fclose(f);
+    free(line);
+    J.result = malloc(J.nlines ? J.nlines : 1);
+    atomic_init(&J.next, 0);
+
+    int nw = thread_count();
+    BatchWorker *W = calloc(nw, sizeof(BatchWorker));
+    pthread_t *tid = malloc(nw * sizeof(pthread_t));
+    double t0 = now_sec();
+    PHASE_BEGIN();
+    for(int w=0;w<nw;w++){
+        W[w].job = &J;
+        W[w].ctx.T = T;
+        if(w > 0) pthread_create(&tid[w], NULL, batch_worker, &W[w]);
+    }
+    batch_worker(&W[0]);
+    for(int w=1;w<nw;w++) pthread_join(tid[w], NULL);
+    PHASE_END(PARSE);
+    double busy = now_sec() - t0;
+
+    long accepted = 0, ntokens = 0, nreduce = 0, ntree = 0;
+    for(int w=0;w<nw;w++){
+        ntokens += W[w].ctx.ntokens; nreduce += W[w].ctx.nreduce; ntree += W[w].ctx.ntree;
+        free(W[w].ctx.stack.s); glr_free(&W[w].ctx.gss); free(W[w].ctx.values.s); tree_free(&W[w].ctx.tree);
+    }
+    for(long i=0;i<J.nlines;i++){
+        if(trace_every > 0 && i % trace_every == 0) parse_input(T, J.lines[i]);
+        accepted += J.result[i];
+        printf("%ld: %s\n", i+1, J.result[i] ? "accept" : "reject");
+        free(J.lines[i]);
+    }
+    printf("%ld lines, %ld accepted, %ld rejected; %ld tokens, %ld reductions in %.3f s on %d thread%s (%.0f tokens/sec)\n",
+           J.nlines, accepted, J.nlines - accepted, ntokens, nreduce, busy, nw, nw == 1 ? "" : "s",
+           busy > 0 ? ntokens / busy : 0.0);
+    if(tree_mode) printf("%ld tree nodes built\n", ntree);
+    free(J.lines); free(J.result); free(W); free(tid);
+    return 0;
+}
+
+// Incremental reparsing, Wagner-Graham style. A document keeps its
+// tokens and, for every token i the parse reached, the parser stack just
+// before token i is read (its checkpoint). Stacks are persistent: nodes
+// live in one arena and point at their parent, so checkpoints share
+// everything below their tops. After an edit only the tokens around it
+// are relexed; parsing resumes from the checkpoint before the first
+// changed token and stops as soon as its stack equals the old checkpoint
+// of a token in the unchanged tail, from where the old parse carries over.
+// Text and tokens are gap buffers with the gap at the last edit, and
+// tokens after the gap count their offsets from the end of the text, so
+// an edit costs the relexed tokens plus the distance from the last edit.
+typedef struct {
+    int state, depth, parent;   // parent -1 below the bottom state
+    unsigned hash;              // hash of the states from the bottom up
+} StackNode;
+
+typedef struct {
+    int id, start, end;         // after the gap, start and end are end-relative
+    int check;                  // stack top before this token is read
+} IncTok;
+
+typedef struct {
+    const ParseTables *T;
+    char *text;                 // text[0..tgap) and text[tgap_end..tcap)
+    int tgap, tgap_end, tcap, len;
+    IncTok *tok;                // tok[0..kgap) and tok[kgap_end..kcap), $ last
+    int kgap, kgap_end, kcap, ntok;
+    int last;                   // token the parse accepted or failed on
+    int accepted;
+    int maxterm;                // longest terminal name
+    StackNode *node;
+    int nnodes, nodecap;
+    char *win;                  // contiguous copy of the text being relexed
+    IncTok *mid;                // relexed tokens
+    int wincap, midcap;
+    int relexed, reparsed;      // tokens lexed and parsed by the last edit
+} IncDoc;
+
+IncTok *inc_tok(IncDoc *D, int i){ return &D->tok[i < D->kgap ? i : i + D->kgap_end - D->kgap]; }
+int inc_tok_start(IncDoc *D, int i){ return inc_tok(D, i)->start + (i < D->kgap ? 0 : D->len); }
+int inc_tok_end(IncDoc *D, int i){ return inc_tok(D, i)->end + (i < D->kgap ? 0 : D->len); }
+
+int inc_push(IncDoc *D, int parent, int state){
+    if(D->nnodes == D->nodecap){
+        D->nodecap = D->nodecap ? 2*D->nodecap : 1024;
+        D->node = realloc(D->node, D->nodecap * sizeof(StackNode));
+    }
+    StackNode *n = &D->node[D->nnodes];
+    n->state = state; n->parent = parent;
+    n->depth = parent < 0 ? 1 : D->node[parent].depth + 1;
+    n->hash = ((parent < 0 ? 2166136261u : D->node[parent].hash) ^ (unsigned)state) * 16777619u;
+    return D->nnodes++;
+}
+
+// stacks a and b hold the same states: compare tops by hash, then walk
+// both down until they reach a shared node
+int inc_same_stack(const IncDoc *D, int a, int b){
+    if(D->node[a].hash != D->node[b].hash || D->node[a].depth != D->node[b].depth) return 0;
+    while(a != b){
+        if(D->node[a].state != D->node[b].state) return 0;
+        a = D->node[a].parent; b = D->node[b].parent;
+    }
+    return 1;
+}
+
+// move the token gap to just before token k, converting offsets of the
+// tokens that cross it
+void inc_move_tok_gap(IncDoc *D, int k){
+    while(D->kgap > k){
+        IncTok t = D->tok[--D->kgap];
+        t.start -= D->len; t.end -= D->len;
+        D->tok[--D->kgap_end] = t;
+    }
+    while(D->kgap < k){
+        IncTok t = D->tok[D->kgap_end++];
+        t.start += D->len; t.end += D->len;
+        D->tok[D->kgap++] = t;
+    }
+}
+
+void inc_grow_tok_gap(IncDoc *D, int need){
+    if(D->kgap_end - D->kgap >= need) return;
+    int tail = D->kcap - D->kgap_end, ncap = 2*D->kcap;
+    while(ncap - D->kgap - tail < need) ncap *= 2;
+    D->tok = realloc(D->tok, ncap * sizeof(IncTok));
+    memmove(D->tok + ncap - tail, D->tok + D->kgap_end, tail * sizeof(IncTok));
+    D->kgap_end = ncap - tail; D->kcap = ncap;
+}
+
+// replace del bytes at lo with r[0..rlen) in the text gap buffer
+void inc_text_edit(IncDoc *D, int lo, int del, const char *r, int rlen){
+    if(D->tgap > lo){
+        int n = D->tgap - lo;
+        memmove(D->text + D->tgap_end - n, D->text + lo, n);
+        D->tgap -= n; D->tgap_end -= n;
+    } else if(D->tgap < lo){
+        int n = lo - D->tgap;
+        memmove(D->text + D->tgap, D->text + D->tgap_end, n);
+        D->tgap += n; D->tgap_end += n;
+    }
+    D->tgap_end += del;
+    if(D->tgap_end - D->tgap < rlen){
+        int tail = D->tcap - D->tgap_end, ncap = 2*D->tcap + rlen;
+        D->text = realloc(D->text, ncap);
+        memmove(D->text + ncap - tail, D->text + D->tgap_end, tail);
+        D->tgap_end = ncap - tail; D->tcap = ncap;
+    }
+    memcpy(D->text + D->tgap, r, rlen);
+    D->tgap += rlen;
+    D->len += rlen - del;
+}
+
+// copy text[a..b) to D->win
+void inc_window(IncDoc *D, int a, int b){
+    if(b - a + 1 > D->wincap){ D->wincap = 2*(b - a + 1); D->win = realloc(D->win, D->wincap); }
+    int n1 = a < D->tgap ? (b < D->tgap ? b : D->tgap) - a : 0;
+    memcpy(D->win, D->text + a, n1);
+    int a2 = a + n1;
+    memcpy(D->win + n1, D->text + a2 + D->tgap_end - D->tgap, b - a2);
+    D->win[b - a] = 0;
+}
+
+// run the parser from token i on its checkpoint to accept or error. Tokens
+// m..tail_last still hold the old parse's checkpoints: the first one that
+// matches means the old outcome (tail_last, tail_accepted) stands.
+void inc_parse(IncDoc *D, int i, int m, int tail_last, int tail_accepted){
+    const ParseTables *T = D->T;
+    int top = inc_tok(D, i)->check;
+    for(;;){
+        IncTok *t = inc_tok(D, i);
+        if(i >= m && i <= tail_last && inc_same_stack(D, top, t->check)){
+            D->last = tail_last; D->accepted = tail_accepted;
+            return;
+        }
+        t->check = top;
+        D->reparsed++;
+        long budget = (long)D->node[top].depth * T->nstates;    // as in parse_input
+        for(;;){
+            int v = tbl_action(T, D->node[top].state, t->id);
+            if(v > 0 && i+1 < D->ntok){
+                top = inc_push(D, top, v - 1);
+                STAT(SHIFTS);
+                i++;
+                break;
+            } else if(v < -1){
+                int p = -v - 1;
+                if(--budget < 0 || T->prod_len[p] >= D->node[top].depth){ D->last = i; D->accepted = 0; return; }
+                for(int k=0;k<T->prod_len[p];k++) top = D->node[top].parent;
+                int nxt = tbl_goto(T, D->node[top].state, T->prod_lhs[p]);
+                if(nxt == -1){ D->last = i; D->accepted = 0; return; }
+                top = inc_push(D, top, nxt);
+                STAT(REDUCTIONS);
+            } else {
+                D->last = i; D->accepted = v == -1;
+                return;
+            }
+        }
+    }
+}
+
+// load text and parse it from scratch
+void inc_open(IncDoc *D, const ParseTables *T, const char *text){
+    memset(D, 0, sizeof(*D));
+    D->T = T;
+    D->len = strlen(text);
+    D->tcap = D->len + 256;
+    D->text = malloc(D->tcap);
+    memcpy(D->text, text, D->len);
+    D->tgap = D->len; D->tgap_end = D->tcap;
+    for(int t=0;t<T->nterms;t++) if(T->term_len[t] > D->maxterm) D->maxterm = T->term_len[t];
+    D->kcap = 64;
+    D->tok = malloc(D->kcap * sizeof(IncTok));
+    int pos = 0;
+    for(;;){
+        if(D->ntok == D->kcap){ D->kcap *= 2; D->tok = realloc(D->tok, D->kcap * sizeof(IncTok)); }
+        int start, id = lex_token(T, text, &pos, D->len, &start);
+        IncTok *t = &D->tok[D->ntok++];
+        t->id = id; t->start = start; t->end = pos; t->check = -1;
+        if(id == T->eof && start == D->len) break;
+    }
+    D->kgap = D->ntok; D->kgap_end = D->kcap;
+    inc_grow_tok_gap(D, 64);
+    D->relexed = D->ntok;
+    inc_tok(D, 0)->check = inc_push(D, -1, 0);
+    inc_parse(D, 0, D->ntok, -1, 0);
+}
+
+// replace del bytes at lo with repl and bring the parse up to date
+void inc_edit(IncDoc *D, int lo, int del, const char *repl){
+    const ParseTables *T = D->T;
+    if(lo < 0) lo = 0;
+    if(lo > D->len) lo = D->len;
+    if(del < 0) del = 0;
+    if(del > D->len - lo) del = D->len - lo;
+    int rlen = strlen(repl);
+
+    // first token k whose longest match could reach into the edit;
+    // parsing resumes there, or where the old parse stopped if earlier
+    int k = 0, hi = D->ntok - 1;
+    while(k < hi){
+        int m = (k + hi) / 2;
+        if(inc_tok_start(D, m) + D->maxterm > lo) hi = m; else k = m + 1;
+    }
+    int r = k < D->last ? k : D->last;
+    int check_r = inc_tok(D, r)->check;
+    int pos0 = k ? inc_tok_end(D, k-1) : 0;
+    inc_move_tok_gap(D, k);
+    inc_text_edit(D, lo, del, repl, rlen);
+
+    // relex from the end of token k-1 until a new token ends, past the
+    // edit, where an old one did: the old tokens after it carry over.
+    // The window grows while a token near its end might run past it.
+    int W = lo + rlen - pos0 + 4*D->maxterm + 64, j, nmid;
+    for(;;){
+        int wend = pos0 + W < D->len ? pos0 + W : D->len;
+        inc_window(D, pos0, wend);
+        int pos = 0, grow = 0;
+        nmid = 0; j = -1;
+        for(;;){
+            int start, id = lex_token(T, D->win, &pos, wend - pos0, &start);
+            if(wend < D->len && pos0 + start + D->maxterm > wend){ grow = 1; break; }
+            if(nmid == D->midcap){ D->midcap = D->midcap ? 2*D->midcap : 64; D->mid = realloc(D->mid, D->midcap * sizeof(IncTok)); }
+            IncTok *t = &D->mid[nmid++];
+            t->id = id; t->start = pos0 + start; t->end = pos0 + pos; t->check = -1;
+            if(id == T->eof && pos0 + start == D->len) break;
+            if(pos0 + pos >= lo + rlen){
+                // old tokens after the gap: find one ending at the same place
+                int a = D->kgap_end, b = D->kcap - 1, e = pos0 + pos - D->len;
+                while(a < b){
+                    int m = (a + b) / 2;
+                    if(D->tok[m].end < e) a = m + 1; else b = m;
+                }
+                if(a < D->kcap - 1 && D->tok[a].end == e){ j = a; break; }
+            }
+        }
+        if(!grow) break;
+        W *= 2;
+    }
+
+    // splice: drop the old tokens up to j, insert the relexed ones
+    int first_tail = j < 0 ? D->kcap : j + 1;   // slot of the first kept old token
+    int ntail = D->kcap - first_tail;
+    int old_last = D->last, old_accepted = D->accepted;
+    int old_ntok = D->ntok;
+    // old index of the first kept token, to map the old parse's last token
+    int om = old_ntok - ntail;
+    D->kgap_end = first_tail;
+    inc_grow_tok_gap(D, nmid);
+    memcpy(D->tok + D->kgap, D->mid, nmid * sizeof(IncTok));
+    D->kgap += nmid;
+    D->ntok = k + nmid + ntail;
+    inc_tok(D, r)->check = check_r;
+    D->relexed = nmid; D->reparsed = 0;
+
+    int m = k + nmid;
+    int tail_last = old_last >= om ? m + old_last - om : -1;
+    inc_parse(D, r, m, tail_last, old_accepted);
+}
+
+void inc_close(IncDoc *D){
+    free(D->text); free(D->tok); free(D->node); free(D->win); free(D->mid);
+    memset(D, 0, sizeof(*D));
+}
+
+// the whole text, NUL-terminated, in a malloc'd buffer
+char *inc_text(IncDoc *D){
+    char *s = malloc(D->len + 1);
+    memcpy(s, D->text, D->tgap);
+    memcpy(s + D->tgap, D->text + D->tgap_end, D->len - D->tgap);
+    s[D->len] = 0;
+    return s;
+}
+
+// Edit replay: the first line of path is the document, every further line
+// an edit "pos del text" (replace del bytes at pos with the rest of the
+// line). Each edit is applied incrementally and checked against, and
+// timed next to, a full reparse of the new text.
+int run_edits(const ParseTables *T, const char *path){
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if(!f){ perror(path); return 1; }
+    char *line = NULL; size_t cap = 0;
+    ssize_t n = getline(&line, &cap, f);
+    if(n < 0){ fprintf(stderr, "%s: no document\n", path); return 1; }
+    line[strcspn(line, "\r\n")] = 0;
+    IncDoc D;
+    double t0 = now_sec();
+    inc_open(&D, T, line);
+    printf("document: %d bytes, %d tokens, %s, parsed in %.1f us\n", D.len, D.ntok,
+           D.accepted ? "accept" : "reject", (now_sec()-t0) * 1e6);
+    StateStack S = {0};
+    int nedits = 0, mismatches = 0;
+    double inc_us = 0, full_us = 0;
+    while((n = getline(&line, &cap, f)) != -1){
+        line[strcspn(line, "\r\n")] = 0;
+        int pos, del, off = 0;
+        if(sscanf(line, "%d %d %n", &pos, &del, &off) < 2){ fprintf(stderr, "bad edit: %s\n", line); continue; }
+        t0 = now_sec();
+        inc_edit(&D, pos, del, line + off);
+        double ti = (now_sec()-t0) * 1e6;
+        char *text = inc_text(&D);
+        t0 = now_sec();
+        int full = parse_quiet(T, &S, text, NULL, NULL);
+        double tf = (now_sec()-t0) * 1e6;
+        free(text);
+        nedits++; inc_us += ti; full_us += tf;
+        if(full != D.accepted) mismatches++;
+        printf("edit %d: %s, relexed %d, reparsed %d of %d tokens, %.1f us (full reparse %.1f us)%s\n",
+               nedits, D.accepted ? "accept" : "reject", D.relexed, D.reparsed, D.ntok, ti, tf,
+               full != D.accepted ? " MISMATCH" : "");
+    }
+    if(f != stdin) fclose(f);
+    printf("%d edits: %.1f us incremental, %.1f us full reparse per edit%s\n", nedits,
+           nedits ? inc_us / nedits : 0.0, nedits ? full_us / nedits : 0.0,
+           mismatches ? ", results differ" : "");
+    free(line); free(S.s);
+    inc_close(&D);
+    return mismatches != 0;
+}
+
+uint64_t mix64(uint64_t x){
+    x ^= x >> 33; x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33; x *= 0xc4ceb9fe1a85ec53ULL;
+    return x ^ (x >> 33);
+}
+
+// digest of nullable, FIRST, FOLLOW, the states and their ACTION/GOTO rows
+// that does not depend on numbering: symbols count by name, states by
+// kernel, shift and goto targets by the target's kernel. Sums make it
+// independent of order too.
+uint64_t automaton_signature(){
+    uint64_t *nh = malloc(nsyms * sizeof(uint64_t)), sig = mix64(nstates);
+    for(int X=0;X<nsyms;X++){
+        uint64_t h = 1469598103934665603ULL;
+        for(const char *c=sym_name[X];*c;c++) h = (h ^ (unsigned char)*c) * 1099511628211ULL;
+        nh[X] = h;
+    }
+    for(int A=0;A<nnon;A++){
+        uint64_t f = nullable[A], w = 0;
+        for(int t=0;t<nterm;t++){
+            if(test_bit(FIRST(A), t)) f += mix64(nh[t]);
+            if(test_bit(FOLLOW(A), t)) w += mix64(nh[t] + 1);
+        }
+        sig += mix64(nh[nterm+A] ^ mix64(f)) + mix64(nh[nterm+A] ^ mix64(w) ^ 1);
+    }
+    for(int s=0;s<nstates;s++){
+        uint64_t row = 0;
+        for(int a=0;a<nterm;a++){
+            if(ACT_TYPE(s, a) == 0) continue;
+            uint64_t v = ACT_TYPE(s, a) == 1 ? states[ACT_VAL(s, a)].hash : (uint64_t)ACT_VAL(s, a);
+            row += mix64(nh[a] ^ mix64(v * 4 + ACT_TYPE(s, a)));
+        }
+        for(int X=nterm;X<nsyms;X++)
+            if(GOTO(s, X) != -1) row += mix64(nh[X] ^ mix64(states[GOTO(s, X)].hash));
+        for(int k=conf_start[s];k<conf_start[s+1];k++){
+            int v = conf_act[k];
+            row += mix64(nh[conf_term[k]] ^ mix64(v > 0 ? states[v-1].hash : (uint64_t)v) ^ 7);
+        }
+        sig += mix64(((uint64_t)states[s].hash << 20 ^ states[s].nkernel) + mix64(row));
+    }
+    free(nh);
+    return sig + mix64(sr_conflicts) + mix64(rr_conflicts + 99);
+}
+
+// replay grammar edits from path, one per line: "+ A->alpha|beta" adds
+// productions, "- N" drops production N (as numbered in the listing) and
+// "- A->alpha" the production with those symbols. Tables are updated in
+// place after each edit; at the end the result is checked against, and
+// timed next to, a rebuild of the final grammar from scratch.
+int run_grammar_edits(const char *path){
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if(!f){ perror(path); return 1; }
+    char *line = NULL; size_t cap = 0;
+    int nedits = 0;
+    double inc_ms = 0, tbl_ms = 0;
+    printf("\nGrammar edits:\n");
+    while(getline(&line, &cap, f) != -1){
+        line[strcspn(line, "\r\n")] = 0;
+        char *arg = line + 1;
+        while(isspace((unsigned char)*arg)) arg++;
+        GrammarDelta d;
+        int r;
+        if(line[0] == '+') r = grammar_add(arg, &d);
+        else if(line[0] == '-'){
+            char *end;
+            long p = strtol(arg, &end, 10);
+            if(end == arg || *end) p = find_production(arg);
+            if(p == -1){ fprintf(stderr, "no production %s\n", arg); continue; }
+            r = grammar_remove(p, &d);
+        } else {
+            if(line[0]) fprintf(stderr, "bad grammar edit: %s\n", line);
+            continue;
+        }
+        if(r != 0) continue;
+        double t0 = now_sec();
+        compress_tables(&ptab);
+        double tt = (now_sec()-t0) * 1e3;
+        nedits++; inc_ms += d.ms; tbl_ms += tt;
+        printf("edit %d: %s: %d productions, %d states, ", nedits, line, nprods, nstates);
+        if(d.full) printf("symbols changed, full rebuild");
+        else printf("FIRST %d/%d changed, FOLLOW %d/%d changed, states %d dirty +%d -%d, %d rows rebuilt",
+                    d.first_changed, d.first_redone, d.follow_changed, d.follow_redone,
+                    d.states_dirty, d.states_added, d.states_removed, d.rows_rebuilt);
+        printf(", %.3f ms (compress %.3f ms)\n", d.ms, tt);
+    }
+    if(f != stdin) fclose(f);
+    free(line);
+    uint64_t inc = automaton_signature();
+    int n = nstates;
+    double t0 = now_sec();
+    rebuild_grammar();
+    compress_tables(&ptab);
+    double full_ms = (now_sec()-t0) * 1e3;
+    int same = automaton_signature() == inc && nstates == n;
+    printf("%d edits: %.3f ms per edit (compress %.3f ms), full rebuild %.3f ms; %d states, %s\n", nedits,
+           nedits ? inc_ms / nedits : 0.0, nedits ? tbl_ms / nedits : 0.0, full_ms, nstates,
+           same ? "same as a full rebuild" : "DIFFERS from a full rebuild");
+    return !same;
+}
+
+// Augment grammar: S' -> S (make new production at index 0 by shifting existing)
+void augment_grammar(){
+    if(nprods == 0) return;
+    char *start = prods[0].name;
+    new_production();
+    // We'll insert new prod at beginning
+    for(int i=nprods-1;i>0;i--) prods[i]=prods[i-1];
+    // name it with the first uppercase letter not used as a lhs, or
+    // failing that the start symbol primed until unique
+    char aug[MAXSTR + 32] = "Z";
+    int found = 0;
+    for(char ch='A';ch<='Z' && !found;ch++){
+        aug[0] = ch; aug[1] = 0;
+        found = 1;
+        for(int i=1;i<nprods;i++) if(strcmp(prods[i].name, aug) == 0){ found = 0; break; }
+    }
+    if(!found){
+        snprintf(aug, sizeof(aug), "%s'", start);
+        for(int i=1;i<nprods;i++)
+            if(strcmp(prods[i].name, aug) == 0){ strcat(aug, "'"); i = 0; }
+    }
+    memset(&prods[0], 0, sizeof(Production));
+    prods[0].name = strdup(aug);
+    prods[0].alt = strdup(start);
+    augmented_index = 0;
+}
+
+// forget the current grammar so another one can be loaded
+void reset_grammar(){
+    for(int p=0;p<nprods;p++){ free(prods[p].name); free(prods[p].alt); free(prods[p].rhs); }
+    for(int X=0;X<nsyms;X++) free(sym_name[X]);
+    free(sym_name); free(sym_rank);
+    sym_name = NULL; sym_rank = NULL;
+    nprods = 0; nnon = 0; nterm = 0; nsyms = 0; nstates = 0;
+    augmented_index = -1; start_symbol = -1; eof_sym = -1;
+}
+
+// expression ladder with n precedence levels:
+//   L0 -> L0 op0 L1 | L1, ..., L(n-1) -> '(' L0 ')' | i
+void gen_ladder(int n){
+    char line[MAXSTR];
+    reset_grammar();
+    for(int k=0;k<n;k++){
+        if(k < n-1) sprintf(line, "L%d->L%d op%d L%d|L%d", k, k, k, k+1, k+1);
+        else sprintf(line, "L%d->( L0 )|i", k);
+        add_production_line(line);
+    }
+    augment_grammar();
+}
+
+// long right-recursive lists, n of them chained:
+//   L0 -> t0 L0 | t0 L1, ..., L(n-1) -> t L(n-1) | t
+void gen_lists(int n){
+    char line[MAXSTR];
+    reset_grammar();
+    for(int k=0;k<n;k++){
+        if(k < n-1) sprintf(line, "L%d->t%d L%d|t%d L%d", k, k, k, k, k+1);
+        else sprintf(line, "L%d->t L%d|t", k, k);
+        add_production_line(line);
+    }
+    augment_grammar();
+}
+
+// wide alternation of n keywords:
+//   S -> S , A | A; A -> kw0 B | ... | kw(n-1) B; B -> i | ( S )
+void gen_alternation(int n){
+    char line[MAXSTR];
+    reset_grammar();
+    strcpy(line, "S->S , A|A"); add_production_line(line);
+    for(int k=0;k<n;k++){ sprintf(line, "A->kw%d B", k); add_production_line(line); }
+    strcpy(line, "B->i|( S )"); add_production_line(line);
+    augment_grammar();
+}
+
+// chain of n nullable nonterminals, each nullable through the next:
+//   S -> N0 z; Nk -> N(k+1) ck | N(k+1) | #, N(n-1) -> c | #
+void gen_nullable(int n){
+    char line[MAXSTR];
+    reset_grammar();
+    strcpy(line, "S->N0 z"); add_production_line(line);
+    for(int k=0;k<n;k++){
+        if(k < n-1) sprintf(line, "N%d->N%d c%d|N%d|#", k, k+1, k, k+1);
+        else sprintf(line, "N%d->c|#", k);
+        add_production_line(line);
+    }
+    augment_grammar();
+}
+
+typedef struct {
+    const char *name;
+    void (*gen)(int n);
+} BenchFamily;
+
+static const BenchFamily bench_families[] = {
+    { "ladder", gen_ladder },
+    { "lists", gen_lists },
+    { "alternation", gen_alternation },
+    { "nullable", gen_nullable },
+};
+
+// one benchmark row: build the family's grammar of size n from scratch
+// until at least 50 ms have passed and print the mean time of every
+// phase. Run in a child process so peak_kb is this grammar's own peak.
+void bench_row(const BenchFamily *F, int n){
+    enum { SYMBOLS, FIRST_SETS, FOLLOW_SETS, STATES, TABLE, COMPRESS, NPHASE };
+    double t[NPHASE] = {0}, total = 0;
+    int reps = 0;
+    do {
+        F->gen(n);
+        double t0 = now_sec(), t1;
+        collect_symbols();  t1 = now_sec(); t[SYMBOLS] += t1 - t0; t0 = t1;
+        compute_first();    t1 = now_sec(); t[FIRST_SETS] += t1 - t0; t0 = t1;
+        compute_follow();   t1 = now_sec(); t[FOLLOW_SETS] += t1 - t0; t0 = t1;
+        build_states();     t1 = now_sec(); t[STATES] += t1 - t0; t0 = t1;
+        build_table();      t1 = now_sec(); t[TABLE] += t1 - t0; t0 = t1;
+        compress_tables(&ptab); t1 = now_sec(); t[COMPRESS] += t1 - t0;
+        total = 0;
+        for(int k=0;k<NPHASE;k++) total += t[k];
+        reps++;
+    } while(total < 0.05 && reps < 1000);
+    // LR(0) items over all states, closures included
+    long nitems = 0;
+    Item *items = NULL; int icap = 0;
+    for(int i=0;i<nstates;i++) nitems += state_items(i, &items, &icap);
+    free(items);
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    printf("%s\t%d\t%d\t%d\t%ld\t%d", F->name, n, nprods, nstates, nitems, reps);
+    for(int k=0;k<NPHASE;k++) printf("\t%.3f", t[k] * 1e3 / reps);
+    printf("\t%.3f\t%.1f\t%zu\t%zu\t%ld\n", total * 1e3 / reps, total * 1e9 / reps / nitems,
+           dense_table_bytes(), compressed_table_bytes(&ptab), ru.ru_maxrss);
+}
+
+// table construction benchmark over the generated grammar families, one
+// tab-separated row per grammar (--lalr and --threads apply)
+int run_bench(){
+    static const int sizes[] = { 4, 16, 50, 100, 200, 400, 1000 };
+    word_terminals = 1;     // the families spell terminals as words (op3, kw7)
+    printf("family\tsize\tprods\tstates\titems\treps\tsymbols_ms\tfirst_ms\tfollow_ms\t"
+           "states_ms\ttable_ms\tcompress_ms\ttotal_ms\tns_per_item\tdense_bytes\ttable_bytes\tpeak_kb\n");
+    for(int f=0;f<(int)(sizeof(bench_families)/sizeof(bench_families[0]));f++){
+        for(int i=0;i<(int)(sizeof(sizes)/sizeof(sizes[0]));i++){
+            fflush(stdout);
+            pid_t pid = fork();
+            if(pid < 0){ perror("fork"); return 1; }
+            if(pid == 0){
+                bench_row(&bench_families[f], sizes[i]);
+                fflush(stdout);
+                _exit(0);
+            }
+            int status;
+            if(waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0){
+                fprintf(stderr, "bench %s %d failed\n", bench_families[f].name, sizes[i]);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// parse each stdin line against tables compiled earlier with --compile
+// (or each line of batch_path, quietly, or replay edits_path)
+int run_parse_mode(const char *path, const char *batch_path, const char *edits_path){
+    double t0 = now_sec();
+    ParseTables T;
+    if(load_tables(&T, path) != 0) return 1;
+    printf("Loaded %d states, %d productions from %s in %.1f us\n",
+           T.nstates, T.nprods, path, (now_sec()-t0) * 1e6);
+    if(batch_path) return run_batch(&T, batch_path);
+    if(edits_path) return run_edits(&T, edits_path);
+    char input[MAXSTR];
+    while(fgets(input, sizeof(input), stdin)){
+        input[strcspn(input, "\n")] = 0;
+        if(strlen(input)==0) continue;
+        if(glr_mode) report_glr(&T, input);
+        else parse_input(&T, input);
+        if(tree_mode) report_tree(&T, input);
+    }
+    return 0;
+}
+
+// read productions one per line from a grammar file, skipping blank lines
+int read_grammar_file(const char *path){
+    FILE *f = fopen(path, "r");
+    if(!f){ perror(path); return -1; }
+    char *line = NULL; size_t cap = 0;
+    while(getline(&line, &cap, f) != -1){
+        line[strcspn(line, "\r\n")] = 0;
+        add_production_line(line);
+    }
+    free(line);
+    fclose(f);
+    if(nprods == 0){ fprintf(stderr, "%s: no productions\n", path); return -1; }
+    return 0;
+}
+
+int main(int argc, char **argv){
+    const char *compile_path = NULL, *cpp_path = NULL, *batch_path = NULL, *table_path = NULL;
+    const char *grammar_path = NULL, *edits_path = NULL, *gedits_path = NULL;
+    int bench = 0;
+    STATS_INIT();
+    for(int i=1;i<argc;i++){
+        if(strcmp(argv[i], "--bench")==0) bench = 1;
+        else if(strcmp(argv[i], "--lalr")==0) lalr_mode = 1;
+        else if(strcmp(argv[i], "--word-terminals")==0) word_terminals = 1;
+        else if(strcmp(argv[i], "--table-stats")==0) table_stats = 1;
+        else if(strcmp(argv[i], "--unit-elim")==0) unit_elim = 1;
+        else if(strcmp(argv[i], "--glr")==0) glr_mode = 1;
+        else if(strcmp(argv[i], "--tree")==0) tree_mode = 1;
+        else if(strcmp(argv[i], "--grammar")==0 && i+1 < argc) grammar_path = argv[++i];
+        else if(strcmp(argv[i], "--compile")==0 && i+1 < argc) compile_path = argv[++i];
+        else if(strcmp(argv[i], "--emit-cpp")==0 && i+1 < argc) cpp_path = argv[++i];
+        else if(strcmp(argv[i], "--parse")==0 && i+1 < argc) table_path = argv[++i];
+        else if(strcmp(argv[i], "--batch")==0 && i+1 < argc) batch_path = argv[++i];
+        else if(strcmp(argv[i], "--edits")==0 && i+1 < argc) edits_path = argv[++i];
+        else if(strcmp(argv[i], "--grammar-edits")==0 && i+1 < argc) gedits_path = argv[++i];
+        else if(strcmp(argv[i], "--trace-every")==0 && i+1 < argc) trace_every = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--threads")==0 && i+1 < argc) nthreads = atoi(argv[++i]);
+        else { fprintf(stderr, "Unknown option %s\n", argv[i]); return 1; }
+    }
+    if(tree_mode && glr_mode){ fprintf(stderr, "--tree needs a deterministic parse, not --glr\n"); return 1; }
+    if(unit_elim && gedits_path){ fprintf(stderr, "--grammar-edits works on the plain tables, not --unit-elim\n"); return 1; }
+    if(bench) return run_bench();
+    if(table_path) return run_parse_mode(table_path, batch_path, edits_path);
+    if(grammar_path){
+        if(read_grammar_file(grammar_path) != 0) return 1;
+    } else {
+        printf("SLR Parser (C) - Enter grammar productions.\n");
+        printf("Conventions: nonterminals are the names left of ->; terminals are other chars (runs of [a-z0-9_] with --word-terminals); epsilon=#\n");
+        int pcount;
+        printf("Enter number of productions: ");
+        if(scanf("%d%*c", &pcount)!=1) return 0;
+        char line[MAXSTR];
+        for(int i=0;i<pcount;i++){
+            printf("Prod %d: ", i+1);
+            if(!fgets(line, sizeof(line), stdin)){ line[0]=0; }
+            if(strlen(line)==0){ i--; continue; }
+            // trim newline
+            line[strcspn(line, "\n")] = 0;
+            add_production_line(line);
+        }
+    }
+    if(nprods == 0){ fprintf(stderr, "No productions\n"); return 1; }
+    augment_grammar();
+
+    collect_symbols();
+    analyze_grammar();
+    build_states();
+    build_table();
+    compress_tables(&ptab);
+    // keep the plain tables to compare against
+    ParseTables plain;
+    int nbypass = 0;
+    if(unit_elim){
+        plain = ptab;
+        memset(&ptab, 0, sizeof(ptab));
+        nbypass = eliminate_unit_reductions();
+        compress_tables(&ptab);
+    }
+
+    // print productions
+    printf("\nProductions (numbered):\n");
+    for(int i=0;i<nprods;i++){
+        printf("%2d: ", i); print_prod(i); printf("\n");
+    }
+    printf("\nNumber of states: %d\n", nstates);
+    if(sr_conflicts || rr_conflicts)
+        printf("%s conflicts: %d shift/reduce (shift chosen), %d reduce/reduce (earlier production chosen)\n",
+               lalr_mode ? "LALR(1)" : "SLR", sr_conflicts, rr_conflicts);
+    if(glr_mode && nconf)
+        printf("GLR: %d actions kept on conflicted entries\n", nconf);
+    if(unit_elim) printf("Unit reductions: %d goto entries bypass unit states\n", nbypass);
+
+    // optional: print ACTION table summary (terminals only)
+    printf("\nACTION (state x terminal) summary (non-empty entries):\n");
+    for(int i=0;i<nstates;i++){
+        for(int a=0;a<nterm;a++){
+            int typ = ACT_TYPE(i, a);
+            if(typ==1) printf("state %d, '%s' : shift %d\n", i, sym_name[a], ACT_VAL(i, a));
+            else if(typ==2) printf("state %d, '%s' : reduce by %d\n", i, sym_name[a], ACT_VAL(i, a));
+            else if(typ==3) printf("state %d, '%s' : accept\n", i, sym_name[a]);
+        }
+    }
+    if(compile_path || cpp_path){
+        if(compile_path){
+            if(save_tables(&ptab, compile_path) != 0) return 1;
+            printf("\nTables written to %s\n", compile_path);
+        }
+        if(cpp_path){
+            if(emit_cpp(&ptab, cpp_path) != 0) return 1;
+            printf("\nDirect-coded parser written to %s\n", cpp_path);
         }
+        return 0;
     }
+    if(batch_path) return run_batch(&ptab, batch_path);
+    if(edits_path) return run_edits(&ptab, edits_path);
+    if(gedits_path) return run_grammar_edits(gedits_path);
     printf("\nNow enter input string to parse (no $ needed) : ");
     char input[MAXSTR];
     if(!fgets(input, sizeof(input), stdin)) return 0;
     input[strcspn(input, "\n")] = 0;
     if(strlen(input)==0) { printf("Empty input. Exiting.\n"); return 0; }
-    parse_input(input);
+    if(glr_mode) report_glr(&ptab, input);
+    else parse_input(&ptab, input);
+    if(tree_mode) report_tree(&ptab, input);
+    if(table_stats) report_table_stats(input);
+    if(unit_elim) report_unit_stats(&plain, &ptab, input);
     return 0;
 }
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Regression test for ll1_parsing: conflicted tables that keep a unit or
+# epsilon cycle (X =>+ X... without reading input) must be rejected, not
+# loop forever. Run from the repository root: sh tests/ll1_cycles.sh
+set -e
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cc -O2 -o "$dir/ll1" ll1_parsing.c
+
+fail=0
+check() {   # grammar, input, expected batch result
+    printf '%b' "$1" > "$dir/g.txt"
+    printf '%s\n' "$2" > "$dir/in.txt"
+    got=$(timeout 5 "$dir/ll1" --grammar "$dir/g.txt" --batch "$dir/in.txt" 2>/dev/null | head -n 1) || true
+    if [ "$got" != "1: $3" ]; then
+        echo "FAIL: $1 on $2: expected $3, got '${got:-timeout}'"
+        fail=1
+    fi
+}
+
+check 'S->S|a\n' 'a$' reject
+check 'S->S|#\n' '$' reject
+check 'S->A|b\nA->S|a\n' 'b$' reject
+check 'E->E+T|T\nT->i\n' 'i+i$' reject
+# epsilon expansions of the same nonterminal that do not nest still accept
+check 'S->XY\nY->XW\nX->#\nW->#\n' '$' accept
+check "E->TE'\nE'->+TE'|#\nT->FT'\nT'->*FT'|#\nF->i|(E)\n" 'i+i*(i)$' accept
+
+[ $fail -eq 0 ] && echo "ll1_cycles: ok"
+exit $fail
@@ -0,0 +1,66 @@
+#!/bin/sh
+# Regression test for slr_real: a table whose conflicts leave a reduction
+# that loops back to its own state (S->#|SS|#: S-># in a state whose goto
+# on S is itself), reached through a state's default reduction or on a
+# valid lookahead, must reject instead of reducing forever, in every driver.
+# Run from the repository root: sh tests/slr_default_reduce.sh
+set -e
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cc -O2 -o "$dir/slr" slr_real.c -pthread -lm
+
+fail=0
+printf 'S->#|SS|#\nA->#|AbS|b\n' > "$dir/cyc.txt"
+printf 'E->E+T|T\nT->T*F|F\nF->(E)|i\n' > "$dir/expr.txt"
+
+# interactive trace: last line of the parse table
+check_trace() {   # grammar, input, expected action
+    got=$(printf '%s\n' "$2" | timeout 5 "$dir/slr" --grammar "$1" 2>/dev/null | tail -n 1 | sed 's/.*| //') || true
+    case "$got" in
+        "$3"*) ;;
+        *) echo "FAIL: trace of $2 on $(basename "$1"): expected $3, got '${got:-timeout}'"; fail=1 ;;
+    esac
+}
+
+check_trace "$dir/cyc.txt" cab error
+check_trace "$dir/cyc.txt" b error
+check_trace "$dir/expr.txt" 'i+i*(i)' accept
+
+# incremental parser: the document's first parse
+printf 'cab\n' > "$dir/doc.txt"
+got=$(timeout 5 "$dir/slr" --grammar "$dir/cyc.txt" --edits "$dir/doc.txt" 2>/dev/null | grep '^document:') || true
+case "$got" in
+    *", reject,"*) ;;
+    *) echo "FAIL: --edits document cab: expected reject, got '${got:-timeout}'"; fail=1 ;;
+esac
+
+# batch parsing, from the grammar and from compiled tables
+printf 'cab\nb\n\n' > "$dir/lines.txt"
+expect='1: reject 2: reject 3: accept'
+check_batch() {   # description, slr_real arguments...
+    what=$1; shift
+    got=$(timeout 5 "$dir/slr" "$@" --batch "$dir/lines.txt" 2>/dev/null | grep '^[0-9]*: ' | tr '\n' ' ') || true
+    if [ "$got" != "$expect " ]; then
+        echo "FAIL: $what: expected '$expect', got '${got:-timeout}'"
+        fail=1
+    fi
+}
+"$dir/slr" --grammar "$dir/cyc.txt" --compile "$dir/cyc.tbl" > /dev/null
+check_batch "--batch" --grammar "$dir/cyc.txt"
+check_batch "--parse --batch" --parse "$dir/cyc.tbl"
+# the thread pool's workers, with and without parse trees
+check_batch "--batch --threads 4" --grammar "$dir/cyc.txt" --threads 4
+check_batch "--batch --tree --threads 4" --grammar "$dir/cyc.txt" --tree --threads 4
+check_batch "--batch --tree" --grammar "$dir/cyc.txt" --tree
+
+# the direct-coded C++ parser
+"$dir/slr" --grammar "$dir/cyc.txt" --emit-cpp "$dir/cyc.cpp" > /dev/null
+c++ -O1 -o "$dir/cyc" "$dir/cyc.cpp"
+got=$(timeout 5 "$dir/cyc" < "$dir/lines.txt" | head -n 3 | tr '\n' ' ') || true
+if [ "$got" != "$expect " ]; then
+    echo "FAIL: --emit-cpp: expected '$expect', got '${got:-timeout}'"
+    fail=1
+fi
+
+[ $fail -eq 0 ] && echo "slr_default_reduce: ok"
+exit $fail
@@ -0,0 +1,40 @@
+#!/bin/sh
+# Regression test for slr_real --parse: a table file whose sections hold
+# out-of-range values must be refused with "corrupt table file" instead of
+# being indexed with them. Run from the repository root: sh tests/slr_table_file.sh
+set -e
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cc -O2 -o "$dir/slr" slr_real.c -pthread -lm
+
+fail=0
+printf 'E->E+T|T\nT->T*F|F\nF->(E)|i\n' > "$dir/expr.txt"
+"$dir/slr" --grammar "$dir/expr.txt" --compile "$dir/expr.tbl" > /dev/null
+got=$(echo 'i+i' | "$dir/slr" --parse "$dir/expr.tbl" --batch - 2>&1 | grep '^1: ') || true
+if [ "$got" != "1: accept" ]; then
+    echo "FAIL: intact table file: expected '1: accept', got '$got'"
+    fail=1
+fi
+
+# header: magic[8], version, size, 10 counts, then the section offsets
+# (tclass, defact, abase, ...) as 32-bit words
+check() {   # section index, word within it, value as printf escapes
+    cp "$dir/expr.tbl" "$dir/bad.tbl"
+    off=$(od -An -tu4 -j $((56 + 4 * $1)) -N4 "$dir/bad.tbl" | tr -d ' ')
+    printf "$3" | dd of="$dir/bad.tbl" bs=1 seek=$((off + 4 * $2)) conv=notrunc 2>/dev/null
+    got=$(echo 'i+i' | "$dir/slr" --parse "$dir/bad.tbl" --batch - 2>&1 | grep -c 'corrupt table file') || true
+    if [ "$got" != 1 ]; then
+        echo "FAIL: section $1 word $2: not reported as corrupt"
+        fail=1
+    fi
+}
+
+check 0 0 '\377\377\377\177'   # terminal class past nclasses
+check 1 0 '\000\000\000\200'   # default reduction past nprods
+check 2 1 '\377\377\377\177'   # action row past the comb
+check 4 0 '\377\377\377\177'   # shift to a state past nstates
+check 5 0 '\377\377\377\177'   # default goto past nstates
+check 12 0 '\377\377\377\177'  # symbol name past the string table
+
+[ $fail -eq 0 ] && echo "slr_table_file: ok"
+exit $fail